@@ -0,0 +1,90 @@
+//===- TemplightProtobufWriterBenchmark.cpp --------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightProtobufWriter.h"
+#include "ThinProtobuf.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+// Begin entries with names and locations like those of a real trace, to
+// cycle through.
+std::vector<PrintableTemplightEntryBegin> makeBeginEntries() {
+  std::mt19937_64 Rng(1);
+  std::vector<PrintableTemplightEntryBegin> Entries(1000);
+  for (PrintableTemplightEntryBegin &Entry : Entries) {
+    Entry.SynthesisKind = int(Rng() % 11);
+    Entry.Name = "ns::t<" + std::to_string(Rng() % 300) + ", std::vector<int>>";
+    Entry.FileName = "/usr/include/f" + std::to_string(Rng() % 200) + ".h";
+    Entry.Line = int(Rng() % 1000);
+    Entry.Column = int(Rng() % 80);
+    Entry.MemoryUsage = Rng() % 100000000;
+    Entry.TempOri_FileName = Entry.FileName;
+    Entry.TempOri_Line = 7;
+    Entry.TempOri_Column = 9;
+  }
+  return Entries;
+}
+
+// Prints a pair of begin and end entries per iteration, for the version of
+// the trace format given as argument. The chunks are written out (to nowhere)
+// every megabyte, such that the trace buffer stays warm.
+void BM_ProtobufWriterPrintEntry(benchmark::State &State) {
+  std::vector<PrintableTemplightEntryBegin> Entries = makeBeginEntries();
+  llvm::raw_null_ostream OS;
+  TemplightProtobufWriter Writer(OS);
+  Writer.setTraceVersion(unsigned(State.range(0)));
+  Writer.setChunkSize(1 << 20);
+  Writer.initialize("a.cpp");
+  double Time = 1.0;
+  std::size_t i = 0;
+  for (auto _ : State) {
+    PrintableTemplightEntryBegin &Begin = Entries[i++ % Entries.size()];
+    Begin.TimeStamp = Time;
+    Writer.printEntry(Begin);
+    Time += 1e-6;
+    Writer.printEntry(
+        PrintableTemplightEntryEnd{Time, Begin.MemoryUsage + 10, 0.0});
+  }
+  Writer.finalize();
+  State.SetItemsProcessed(State.iterations() * 2);
+}
+BENCHMARK(BM_ProtobufWriterPrintEntry)->Arg(1)->Arg(2);
+
+// Encodes a varint field per iteration, of every size from 1 to 10 bytes.
+void BM_ThinProtobufSaveVarInt(benchmark::State &State) {
+  std::mt19937_64 Rng(2);
+  std::vector<std::uint64_t> Values(1024);
+  for (std::size_t i = 0; i < Values.size(); ++i)
+    Values[i] = Rng() >> (i % 64);
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  std::size_t i = 0;
+  for (auto _ : State) {
+    llvm::protobuf::saveVarInt(OS, 5, Values[i++ % Values.size()]);
+    if (Out.size() > (1 << 20)) {
+      OS.flush();
+      Out.clear();
+    }
+  }
+  State.SetItemsProcessed(State.iterations());
+}
+BENCHMARK(BM_ThinProtobufSaveVarInt);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,68 @@
+//===- TemplightYamlWriterBenchmark.cpp ------------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightExtraWriters.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+// Begin entries with names and locations like those of a real trace (which
+// all need quotes), to cycle through.
+std::vector<PrintableTemplightEntryBegin> makeBeginEntries() {
+  std::mt19937_64 Rng(1);
+  std::vector<PrintableTemplightEntryBegin> Entries(1000);
+  for (PrintableTemplightEntryBegin &Entry : Entries) {
+    Entry.Name = "ns::t<" + std::to_string(Rng() % 300) + ", std::vector<int>>";
+    Entry.FileName = "/usr/include/f" + std::to_string(Rng() % 200) + ".h";
+    Entry.Line = int(Rng() % 1000);
+    Entry.Column = int(Rng() % 80);
+    Entry.MemoryUsage = Rng() % 100000000;
+    Entry.TempOri_FileName = Entry.FileName;
+    Entry.TempOri_Line = 7;
+    Entry.TempOri_Column = 9;
+  }
+  return Entries;
+}
+
+// Writes a pair of begin and end entries per iteration.
+void BM_YamlWriter(benchmark::State &State) {
+  std::vector<PrintableTemplightEntryBegin> Entries = makeBeginEntries();
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  TemplightYamlWriter Writer(OS);
+  Writer.initialize("a.cpp");
+  double Time = 0.0;
+  std::size_t i = 0;
+  for (auto _ : State) {
+    PrintableTemplightEntryBegin &Begin = Entries[i++ % Entries.size()];
+    Begin.TimeStamp = Time;
+    Writer.printEntry(Begin);
+    Time += 1e-6;
+    Writer.printEntry(
+        PrintableTemplightEntryEnd{Time, Begin.MemoryUsage + 10, 0.0});
+    if (Out.size() > (1 << 24)) {
+      OS.flush();
+      Out.clear();
+    }
+  }
+  Writer.finalize();
+  State.SetItemsProcessed(State.iterations() * 2);
+}
+BENCHMARK(BM_YamlWriter);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -12,6 +12,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace llvm {
 class raw_ostream;
@@ -30,11 +31,33 @@ struct PrintableTemplightEntryBegin {
   std::string TempOri_FileName;
   int TempOri_Line;
   int TempOri_Column;
+  // The id of the dictionary entry of the name, if the name is given as a
+  // structural dictionary entry instead of the printed name.
+  std::size_t DictionaryId = ~std::size_t(0);
 };
 
 struct PrintableTemplightEntryEnd {
   double TimeStamp;
   std::uint64_t MemoryUsage;
+  double PrunedChildrenTime;
+};
+
+struct PrintableTemplightSummaryEntry {
+  int SynthesisKind;
+  std::string Name;
+  std::string FileName;
+  int Line;
+  int Column;
+  std::uint64_t Count;
+  double InclusiveTime;
+  double ExclusiveTime;
+  unsigned MaxDepth;
+};
+
+struct PrintableTemplightDictionaryEntry {
+  std::size_t Id;
+  std::string MarkedName; // with a '\0' character in place of each marker.
+  std::vector<std::size_t> MarkerIds; // ids of earlier dictionary entries.
 };
 
 class TemplightWriter {
@@ -48,6 +71,16 @@ public:
   virtual void printEntry(const PrintableTemplightEntryBegin &aEntry) = 0;
   virtual void printEntry(const PrintableTemplightEntryEnd &aEntry) = 0;
 
+  /// \brief Prints the aggregated statistics of one template (and kind of
+  /// synthesis), as produced by the summary mode of the tracer.
+  virtual void printSummary(const PrintableTemplightSummaryEntry &aEntry) {}
+
+  /// \brief Prints an entry of the dictionary of names built by the tracer
+  /// from the structure of the AST, which comes before the first entry that
+  /// refers to it by its id.
+  virtual void
+  printDictionaryEntry(const PrintableTemplightDictionaryEntry &aEntry) {}
+
 protected:
   llvm::raw_ostream &OutputOS;
 };
@@ -12,6 +12,8 @@
 
 #include <memory>
 
+#include "TemplightTracer.h"
+
 #include "clang/Frontend/CompilerInstance.h"
 #include "clang/Frontend/FrontendAction.h"
 #include "llvm/ADT/StringRef.h"
@@ -49,8 +51,22 @@ public:
   unsigned OutputToStdOut : 1;
   unsigned MemoryProfile : 1;
   unsigned OutputInSafeMode : 1;
+  unsigned AsyncOutput : 1;
+  unsigned SummaryOutput : 1;
+  unsigned StructuralNames : 1;
+  unsigned CompressOutput : 1;
+  unsigned TraceIndex : 1;
+  unsigned TraceFrames : 1;
   unsigned IgnoreSystemInst : 1;
   unsigned InteractiveDebug : 1;
+  TemplightTracer::ClockKind ClockSource;
+  TemplightTracer::MemorySourceKind MemorySource;
+  unsigned MemorySampleInterval;
+  unsigned MemorySampleEvents;
+  unsigned MinDuration;
+  unsigned ChunkSize;
+  unsigned TraceVersion;
+  int CompressLevel;
   std::string OutputFilename;
   std::string BlackListFilename;
 
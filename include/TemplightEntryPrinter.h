@@ -12,6 +12,8 @@
 
 #include "PrintableTemplightEntries.h"
 
+#include <llvm/ADT/StringRef.h>
+
 #include <memory>
 #include <string>
 
@@ -31,6 +33,8 @@ public:
 
   void printEntry(const PrintableTemplightEntryBegin &Entry);
   void printEntry(const PrintableTemplightEntryEnd &Entry);
+  void printSummary(const PrintableTemplightSummaryEntry &Entry);
+  void printDictionaryEntry(const PrintableTemplightDictionaryEntry &Entry);
 
   void initialize(const std::string &SourceName = "");
   void finalize();
@@ -44,6 +48,8 @@ public:
   void takeWriter(TemplightWriter *aPWriter);
 
   void readBlacklists(const std::string &BLFilename);
+  bool hasBlacklists() const;
+  bool isBlacklisted(llvm::StringRef Name) const;
 
 private:
   std::size_t SkippedEndingsCount;
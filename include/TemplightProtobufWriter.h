@@ -12,8 +12,15 @@
 
 #include "PrintableTemplightEntries.h"
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Allocator.h>
+
+#include <cstdint>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 namespace llvm {
 class raw_ostream;
@@ -24,16 +31,107 @@ namespace clang {
 class TemplightProtobufWriter : public TemplightWriter {
 private:
   std::string buffer;
+  std::string dictionaryBuffer; // the new names of the current chunk.
+  std::size_t headerSize;
   std::unordered_map<std::string, std::size_t> fileNameMap;
-  std::unordered_map<std::string, std::size_t> templateNameMap;
+  llvm::StringMap<std::size_t, llvm::BumpPtrAllocator> templateNameMap;
+  llvm::StringMap<std::size_t, llvm::BumpPtrAllocator> dictionaryEntryMap;
+  std::vector<std::size_t> structuralIds; // tracer's ids -> dictionary ids.
   int compressionMode;
+  unsigned traceVersion;
+  unsigned traceCompression; // 0: none, 1: zlib or 2: zstd.
+  int traceCompressionLevel;
+  std::string sourceName;
+  std::size_t chunkSize;
+  unsigned chunkIndex;
+  std::size_t depth;
+  std::int64_t lastTimeStamp; // in nanoseconds, for version 2.
+  std::uint64_t lastMemoryUsage;
+
+  // The index of the chunks and top-level instantiation trees, written at
+  // the end of the trace.
+  struct IndexedChunk {
+    std::uint64_t Offset; // of the trace, in the output.
+    std::uint64_t NamesOffset;
+    std::uint64_t NamesSize;
+  };
+  struct IndexedTree {
+    unsigned Chunk;
+    std::uint64_t Offset; // of the first entry, in the trace.
+    std::uint64_t Size;
+    double TimeStamp;
+    double Duration;
+    std::int64_t BaseTime; // the deltas start from there, for version 2.
+    std::uint64_t BaseMemory;
+  };
+  bool traceIndex;
+  std::vector<IndexedChunk> indexedChunks;
+  std::vector<IndexedTree> indexedTrees;
+  std::size_t firstChunkTree; // the first tree of the current chunk.
+  bool traceFrames;
+
+  llvm::SmallVector<std::uint8_t, 0> compressedName;
+  llvm::SmallVector<std::uint8_t, 0> compressedTrace;
+
+  // The encoded fields of sub-messages, whose sizes are computed before the
+  // message that contains them is written out.
+  struct EntryLocation;
+  struct EntryTemplateName;
+
+  // A piece of the marked name of a dictionary entry, either a range of the
+  // printed name, or a marker for the dictionary entry of id 'Lo'.
+  struct NamePiece {
+    std::size_t Lo;
+    std::size_t Hi;
+    bool IsMarker;
+  };
+
+  // The state of the tokenizer for one component of a name (the full name,
+  // or one of the template arguments within it).
+  struct NameFrame {
+    std::size_t Lo;         // start of the component (trimmed).
+    std::size_t LitLo;      // start of the text not yet in the pieces.
+    std::size_t SegLo;      // start of the current "::"-separated segment.
+    std::size_t OpenPos;    // position of the '<' of the open argument list.
+    std::size_t PrefixId;   // dictionary id of the name before that '<'.
+    std::size_t FirstPiece; // index of the first piece of this component.
+    unsigned ParenDepth;
+    bool HasMarkers;
+  };
+
+  std::vector<NamePiece> namePieces;
+  std::vector<NameFrame> nameFrames;
+  llvm::SmallString<128> nameScratch;
 
+  void pushNameFrame(std::size_t Lo);
+  void addNameMarker(NameFrame &F, std::size_t Lo, std::size_t Hi,
+                     std::size_t Id);
+  std::size_t internDictionaryEntry();
+  std::size_t internNamePieces(llvm::StringRef Name, std::size_t FirstPiece);
+  std::size_t internLeafName(llvm::StringRef Name, std::size_t Lo,
+                             std::size_t Hi);
+  std::size_t finishNameFrame(llvm::StringRef Name, NameFrame &F,
+                              std::size_t Lo, std::size_t Hi);
+  void closeNameArgument(llvm::StringRef Name, std::size_t i);
+
+  void printHeader();
+  void writeTrace();
+  void writeIndex();
+  void writeFrame();
+  void flushChunk();
   std::size_t createDictionaryEntry(const std::string &Name);
-  std::string printEntryLocation(const std::string &FileName, int Line,
-                                 int Column);
-  std::string printTemplateName(const std::string &Name);
+  void getEntryLocation(const std::string &FileName, int Line, int Column,
+                        EntryLocation &Loc);
+  void getTemplateName(const std::string &Name, EntryTemplateName &TName);
+  void getEntryDeltas(double TimeStamp, std::uint64_t MemoryUsage,
+                      std::int64_t &TimeDelta, std::int64_t &MemoryDelta);
 
 public:
+  /// \brief The magic number in the sync marker of every frame of a
+  /// framed trace (see setTraceFrames), from which a reader can find the
+  /// next intact frame after a corrupted or truncated one.
+  static constexpr std::uint32_t FrameSyncMagic = 0x9E4C17A5;
+
   TemplightProtobufWriter(llvm::raw_ostream &aOS, int aCompressLevel = 2);
 
   void initialize(const std::string &aSourceName = "") override;
@@ -41,6 +139,47 @@ public:
 
   void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
   void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+  void printSummary(const PrintableTemplightSummaryEntry &aEntry) override;
+  void printDictionaryEntry(
+      const PrintableTemplightDictionaryEntry &aEntry) override;
+
+  /// \brief Writes out the trace in chunks of about \p aChunkSize bytes (each
+  /// one a TemplightTrace that continues the previous one), instead of
+  /// keeping the whole trace in memory until the end (if zero).
+  void setChunkSize(std::size_t aChunkSize) { chunkSize = aChunkSize; }
+
+  /// \brief Sets the version of the trace format to write. Version 2 stores
+  /// the time-stamps and memory usages as (zigzag) deltas from the previous
+  /// entry, in integer nanoseconds and bytes, instead of absolute values.
+  /// This must be set before the writer is initialized.
+  void setTraceVersion(unsigned aVersion) { traceVersion = aVersion; }
+
+  /// \brief Compresses each chunk of the trace as a whole (with zstd if LLVM
+  /// supports it, or zlib otherwise), at level \p aLevel (or the default
+  /// level of the format, if zero).
+  void setTraceCompression(bool aCompress, int aLevel = 0);
+
+  /// \brief Appends an index to the trace, with the offsets of the chunks,
+  /// of the names of each chunk, and the offset, start time and duration of
+  /// each top-level instantiation tree, such that a reader can go straight
+  /// to any tree (see TemplightProtobufReader::loadIndex). The offsets count
+  /// backwards from the index, which is found from the end of the output, so
+  /// the index of the last trace of concatenated outputs still holds.
+  void setTraceIndex(bool aIndex) { traceIndex = aIndex; }
+
+  /// \brief Writes out (and flushes) every entry as soon as it is printed,
+  /// in a frame of its own: a sync marker (FrameSyncMagic and the CRC-32 of
+  /// the frame, in the sync_markers field of the TemplightTraceCollection)
+  /// followed by the fields of the TemplightTrace that came since the
+  /// previous frame (the header, the new names and the entry, in the
+  /// trace_frames field). The readers that predate these fields cannot read
+  /// such a trace. In recovery mode (see
+  /// TemplightProtobufReader::setRecoveryMode), a trace that is cut short
+  /// (e.g., by a crash) is read up to its last complete entry, the corrupted
+  /// frames are skipped up to the next intact one, and the entries that were
+  /// still open at the crash point are reported (OpenEntries). The chunk
+  /// size, compression and index are ignored with frames.
+  void setTraceFrames(bool aTraceFrames) { traceFrames = aTraceFrames; }
 };
 
 } // namespace clang
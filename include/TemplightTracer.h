@@ -12,6 +12,7 @@
 
 #include "clang/Sema/TemplateInstCallback.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -21,6 +22,20 @@ class TemplightTracer : public TemplateInstantiationCallback {
 public:
   class TracePrinter; // forward-decl.
 
+  /// \brief The clock sources that can be used to time-stamp the entries.
+  enum ClockKind {
+    RUsageClock,        ///< User CPU-time of the process (getrusage).
+    MonotonicClock,     ///< Wall-clock time from the monotonic clock.
+    ThreadCPUTimeClock, ///< CPU-time consumed by the compiler thread.
+    TSCClock            ///< CPU cycle counter, calibrated at initialize().
+  };
+
+  /// \brief The sources that can be used to measure the memory usage.
+  enum MemorySourceKind {
+    MallocMemory, ///< Total heap usage reported by the allocator (mallinfo).
+    ASTMemory     ///< Memory held by the AST context and Sema allocators.
+  };
+
   void initialize(const Sema &TheSema) override;
   void finalize(const Sema &TheSema) override;
   void atTemplateBegin(const Sema &TheSema,
@@ -31,9 +46,19 @@ public:
 private:
   unsigned MemoryFlag : 1;
   unsigned SafeModeFlag : 1;
+  unsigned AsyncFlag : 1;
+  unsigned SummaryFlag : 1;
+
+  ClockKind Clock;
+  std::uint64_t CycleCounterBase;
+  double CycleCounterBaseTime;
+  double SecondsPerCycle;
 
   std::unique_ptr<TracePrinter> Printer;
 
+  void calibrateClock();
+  double getTimeStamp() const;
+
 public:
   /// \brief Sets the format type of the template trace file.
   /// The argument can be xml/yaml/text
@@ -46,6 +71,63 @@ public:
   bool getMemoryFlag() const { return MemoryFlag; };
   bool getSafeModeFlag() const { return SafeModeFlag; };
 
+  /// \brief Moves the printing of the trace entries (name look-ups in the
+  /// output dictionary, encoding and writing) to a separate thread, fed by a
+  /// lock-free queue. This has no effect in safe-mode. The rusage clock is
+  /// replaced by the thread-cputime clock, since it would count that thread.
+  void setAsyncFlag(bool Async) { AsyncFlag = Async; };
+  bool getAsyncFlag() const { return AsyncFlag; };
+
+  /// \brief Aggregates the entries per template (and kind of synthesis) and
+  /// only outputs the summary of each template when the trace ends, instead
+  /// of the full trace.
+  void setSummaryFlag(bool Summary) { SummaryFlag = Summary; };
+  bool getSummaryFlag() const { return SummaryFlag; };
+
+  /// \brief Builds the dictionary of names from the structure of the AST
+  /// (templates, canonical types and template arguments) instead of printing
+  /// and parsing the name of each instantiated entity.
+  void setStructuralNamesFlag(bool StructuralNames);
+  bool getStructuralNamesFlag() const;
+
+  /// \brief Sets the clock used to time-stamp the template trace entries.
+  /// This must be set before the tracer is initialized by Sema.
+  void setClockKind(ClockKind aClock) { Clock = aClock; };
+  ClockKind getClockKind() const { return Clock; };
+
+  /// \brief Sets how the memory usage is measured when profiling memory.
+  /// The memory is read at most once every \p IntervalUS microseconds or
+  /// every \p Events entries, whichever comes first, and the entries in
+  /// between are interpolated (zero for both means every entry is measured).
+  void setMemorySampling(MemorySourceKind aSource, unsigned IntervalUS = 0,
+                         unsigned Events = 0);
+
+  /// \brief Drops the sub-trees of instantiations that took less than
+  /// \p DurationUS microseconds, and adds their time to the end entry of their
+  /// parent instead. This has no effect in safe-mode.
+  void setMinDuration(unsigned DurationUS);
+
+  /// \brief Writes the trace to the output file every \p ChunkSizeMB
+  /// megabytes, instead of keeping it all in memory until the end (if zero).
+  void setChunkSize(unsigned ChunkSizeMB);
+
+  /// \brief Sets the version of the trace format (1 or 2, see
+  /// TemplightProtobufWriter::setTraceVersion).
+  void setTraceVersion(unsigned Version);
+
+  /// \brief Compresses each chunk of the trace as a whole, at level \p Level
+  /// (see TemplightProtobufWriter::setTraceCompression).
+  void setTraceCompression(bool Compress, int Level = 0);
+
+  /// \brief Appends an index of the top-level instantiations to the trace
+  /// (see TemplightProtobufWriter::setTraceIndex).
+  void setTraceIndex(bool Index);
+
+  /// \brief Writes every entry in a frame of its own, which can be recovered
+  /// after a crash (see TemplightProtobufWriter::setTraceFrames). This implies
+  /// safe-mode.
+  void setTraceFrames(bool Frames);
+
   void readBlacklists(const std::string &BLFilename);
 };
 
@@ -47,13 +47,13 @@ inline std::uint64_t loadVarInt(StringRef &p_buf) {
     return u;
   std::uint8_t shifts = 0;
   while (p_buf.front() & 0x80) {
-    u |= (p_buf.front() & 0x7F) << shifts;
+    u |= std::uint64_t(p_buf.front() & 0x7F) << shifts;
     p_buf = p_buf.drop_front(1);
     if (p_buf.empty())
       return u;
     shifts += 7;
   };
-  u |= (p_buf.front() & 0x7F) << shifts;
+  u |= std::uint64_t(p_buf.front() & 0x7F) << shifts;
   p_buf = p_buf.drop_front(1);
   return u;
 }
@@ -93,6 +93,20 @@ template <unsigned int tag> struct getDoubleWire {
   static const unsigned int value = (tag << 3) | 1;
 };
 
+inline std::uint64_t loadFixed64(StringRef &p_buf) {
+  if (p_buf.size() < sizeof(std::uint64_t)) {
+    p_buf = p_buf.drop_front(p_buf.size());
+    return 0;
+  };
+  std::uint64_t u = llvm::support::endian::read64le(p_buf.data());
+  p_buf = p_buf.drop_front(sizeof(std::uint64_t));
+  return u;
+}
+
+template <unsigned int tag> struct getFixed64Wire {
+  static const unsigned int value = (tag << 3) | 1;
+};
+
 inline float loadFloat(StringRef &p_buf) {
   if (p_buf.size() < sizeof(float_to_ulong)) {
     p_buf = p_buf.drop_front(p_buf.size());
@@ -134,6 +148,18 @@ inline std::string loadString(StringRef &p_buf) {
   return s; // NRVO
 }
 
+// Same as loadString, but refers to the bytes within the buffer.
+inline StringRef loadStringRef(StringRef &p_buf) {
+  unsigned int u = loadVarInt(p_buf);
+  if (p_buf.size() < u) {
+    p_buf = p_buf.drop_front(p_buf.size());
+    return StringRef();
+  };
+  StringRef s = p_buf.take_front(u);
+  p_buf = p_buf.drop_front(u);
+  return s;
+}
+
 template <unsigned int tag> struct getStringWire {
   static const unsigned int value = (tag << 3) | 2;
 };
@@ -219,6 +245,14 @@ inline void saveDouble(llvm::raw_ostream &OS, unsigned int tag, double d) {
   saveDouble(OS, d);
 }
 
+inline void saveFixed64(llvm::raw_ostream &OS, unsigned int tag,
+                        std::uint64_t u) {
+  saveVarInt(OS, (tag << 3) | 1); // wire-type 1: 64-bit.
+  u = llvm::support::endian::byte_swap<std::uint64_t,
+                                       llvm::endianness::little>(u);
+  OS.write(reinterpret_cast<char *>(&u), sizeof(std::uint64_t));
+}
+
 inline void saveFloat(llvm::raw_ostream &OS, float d) {
   float_to_ulong tmp = {d};
   tmp.ui32 = llvm::support::endian::byte_swap<
@@ -254,6 +288,50 @@ inline void saveString(llvm::raw_ostream &OS, unsigned int tag, StringRef s) {
   saveString(OS, s);
 }
 
+// Writes the key and length of a length-delimited field (e.g., a nested
+// message) whose 'len' bytes of contents must be written right after.
+inline void saveStringHeader(llvm::raw_ostream &OS, unsigned int tag,
+                             std::uint64_t len) {
+  saveVarInt(OS, (tag << 3) | 2); // wire-type 2: length-delimited.
+  saveVarInt(OS, len);
+}
+
+// The following compute the encoded sizes of fields, such that the length
+// of nested messages can be written before their contents, without having
+// to encode them into temporary buffers first.
+
+inline std::size_t getVarIntSize(std::uint64_t u) {
+  std::size_t n = 1;
+  while (u >>= 7)
+    ++n;
+  return n;
+}
+
+inline std::size_t getVarIntFieldSize(unsigned int tag, std::uint64_t u) {
+  return getVarIntSize(tag << 3) + getVarIntSize(u);
+}
+
+inline std::size_t getSIntFieldSize(unsigned int tag, std::int64_t i) {
+  return getVarIntSize(tag << 3) +
+         getVarIntSize((i << 1) ^ (i >> (sizeof(std::int64_t) * 8 - 1)));
+}
+
+inline std::size_t getDoubleFieldSize(unsigned int tag) {
+  return getVarIntSize((tag << 3) | 1) + sizeof(double_to_ulong);
+}
+
+inline std::size_t getFloatFieldSize(unsigned int tag) {
+  return getVarIntSize((tag << 3) | 5) + sizeof(float_to_ulong);
+}
+
+inline std::size_t getBoolFieldSize(unsigned int tag) {
+  return getVarIntSize(tag << 3) + 1;
+}
+
+inline std::size_t getStringFieldSize(unsigned int tag, std::size_t len) {
+  return getVarIntSize((tag << 3) | 2) + getVarIntSize(len) + len;
+}
+
 } // namespace protobuf
 
 } // namespace llvm
@@ -110,6 +110,18 @@ void TemplightAction::ExecuteAction() {
     std::unique_ptr<TemplightTracer> p_t(
         new TemplightTracer(CI.getSema(), OutputFilename, MemoryProfile,
                             OutputInSafeMode, IgnoreSystemInst));
+    p_t->setClockKind(ClockSource);
+    p_t->setAsyncFlag(AsyncOutput);
+    p_t->setSummaryFlag(SummaryOutput);
+    p_t->setMinDuration(MinDuration);
+    p_t->setChunkSize(ChunkSize);
+    p_t->setTraceVersion(TraceVersion);
+    p_t->setTraceCompression(CompressOutput, CompressLevel);
+    p_t->setTraceIndex(TraceIndex);
+    p_t->setTraceFrames(TraceFrames);
+    p_t->setStructuralNamesFlag(StructuralNames);
+    p_t->setMemorySampling(MemorySource, MemorySampleInterval,
+                           MemorySampleEvents);
     p_t->readBlacklists(BlackListFilename);
     CI.getSema().TemplateInstCallbacks.push_back(std::move(p_t));
   }
@@ -150,6 +162,12 @@ bool TemplightAction::hasCodeCompletionSupport() const {
 TemplightAction::TemplightAction(std::unique_ptr<FrontendAction> WrappedAction)
     : WrapperFrontendAction(std::move(WrappedAction)), InstProfiler(false),
       OutputToStdOut(false), MemoryProfile(false), OutputInSafeMode(false),
-      IgnoreSystemInst(false), InteractiveDebug(false) {}
+      AsyncOutput(false), SummaryOutput(false), StructuralNames(false),
+      CompressOutput(false), TraceIndex(false), TraceFrames(false),
+      IgnoreSystemInst(false), InteractiveDebug(false),
+      ClockSource(TemplightTracer::RUsageClock),
+      MemorySource(TemplightTracer::MallocMemory), MemorySampleInterval(0),
+      MemorySampleEvents(0), MinDuration(0), ChunkSize(0), TraceVersion(1),
+      CompressLevel(0) {}
 
 } // namespace clang
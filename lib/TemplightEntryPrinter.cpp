@@ -35,8 +35,7 @@ bool TemplightEntryPrinter::shouldIgnoreEntry(
     return true;
   }
   // (2) Regexes:
-  if ((CoRegex && (CoRegex->match(Entry.Name))) ||
-      (IdRegex && (IdRegex->match(Entry.Name)))) {
+  if (isBlacklisted(Entry.Name)) {
     skipEntry();
     return true;
   }
@@ -73,6 +72,21 @@ void TemplightEntryPrinter::printEntry(
     p_writer->printEntry(Entry);
 }
 
+void TemplightEntryPrinter::printSummary(
+    const PrintableTemplightSummaryEntry &Entry) {
+  // NOTE: The blacklists apply to each instantiation, before aggregation.
+  if (p_writer)
+    p_writer->printSummary(Entry);
+}
+
+void TemplightEntryPrinter::printDictionaryEntry(
+    const PrintableTemplightDictionaryEntry &Entry) {
+  // NOTE: Dictionary entries are never skipped, because the entries that
+  // follow may refer to them.
+  if (p_writer)
+    p_writer->printDictionaryEntry(Entry);
+}
+
 void TemplightEntryPrinter::initialize(const std::string &SourceName) {
   if (p_writer)
     p_writer->initialize(SourceName);
@@ -173,4 +187,12 @@ void TemplightEntryPrinter::readBlacklists(const std::string &BLFilename) {
   return;
 }
 
+bool TemplightEntryPrinter::hasBlacklists() const {
+  return CoRegex || IdRegex;
+}
+
+bool TemplightEntryPrinter::isBlacklisted(llvm::StringRef Name) const {
+  return (CoRegex && CoRegex->match(Name)) || (IdRegex && IdRegex->match(Name));
+}
+
 } // namespace clang
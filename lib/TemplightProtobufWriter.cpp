@@ -11,12 +11,15 @@
 #include "PrintableTemplightEntries.h"
 
 #include "ThinProtobuf.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/StringExtras.h"
 
+#include <llvm/Support/CRC.h>
 #include <llvm/Support/Compression.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <cmath>
 #include <cstdint>
 #include <string>
 
@@ -24,9 +27,13 @@ namespace clang {
 
 TemplightProtobufWriter::TemplightProtobufWriter(llvm::raw_ostream &aOS,
                                                  int aCompressLevel)
-    : TemplightWriter(aOS), compressionMode(aCompressLevel) {}
+    : TemplightWriter(aOS), headerSize(0), compressionMode(aCompressLevel),
+      traceVersion(1), traceCompression(0), traceCompressionLevel(0),
+      chunkSize(0), chunkIndex(0), depth(0), lastTimeStamp(0),
+      lastMemoryUsage(0), traceIndex(false), firstChunkTree(0),
+      traceFrames(false) {}
 
-void TemplightProtobufWriter::initialize(const std::string &aSourceName) {
+void TemplightProtobufWriter::printHeader() {
 
   std::string hdr_contents;
   {
@@ -36,328 +43,840 @@ void TemplightProtobufWriter::initialize(const std::string &aSourceName) {
   message TemplightHeader {
     required uint32 version = 1;
     optional string source_file = 2;
+    optional uint32 chunk = 3;
   }
     */
 
-    llvm::protobuf::saveVarInt(OS_inner, 1, 1); // version
-    if (!aSourceName.empty())
-      llvm::protobuf::saveString(OS_inner, 2, aSourceName); // source_file
+    llvm::protobuf::saveVarInt(OS_inner, 1, traceVersion); // version
+    if (!sourceName.empty())
+      llvm::protobuf::saveString(OS_inner, 2, sourceName); // source_file
+    if (chunkIndex > 0)
+      llvm::protobuf::saveVarInt(OS_inner, 3, chunkIndex); // chunk
   }
 
   llvm::raw_string_ostream OS(buffer);
 
   // required TemplightHeader header = 1;
   llvm::protobuf::saveString(OS, 1, hdr_contents);
+  OS.flush();
+  headerSize = buffer.size();
+
+  // The deltas start over in each chunk.
+  lastTimeStamp = 0;
+  lastMemoryUsage = 0;
+}
+
+void TemplightProtobufWriter::writeTrace() {
+  // The names of the chunk go right after its header, such that they can be
+  // loaded without going through the entries.
+  buffer.insert(headerSize, dictionaryBuffer);
+  if (traceIndex) {
+    indexedChunks.push_back(
+        {OutputOS.tell(), headerSize, dictionaryBuffer.size()});
+    for (std::size_t i = firstChunkTree; i < indexedTrees.size(); ++i)
+      indexedTrees[i].Offset += dictionaryBuffer.size();
+    firstChunkTree = indexedTrees.size();
+  }
+  dictionaryBuffer.clear();
+
+  if (!traceCompression) {
+    // repeated TemplightTrace traces = 1;
+    llvm::protobuf::saveString(OutputOS, 1, buffer);
+    return;
+  }
+
+  llvm::compression::Format Format =
+      (traceCompression == 2 ? llvm::compression::Format::Zstd
+                             : llvm::compression::Format::Zlib);
+  llvm::compression::Params Params(Format);
+  if (traceCompressionLevel > 0)
+    Params.level = traceCompressionLevel;
+  compressedTrace.clear();
+  llvm::compression::compress(Params, llvm::arrayRefFromStringRef(buffer),
+                              compressedTrace);
+
+  /*
+  message CompressedTrace {
+    required CompressionFormat format = 1;
+    required uint64 size = 2;
+    required bytes data = 3;
+    optional uint32 chunk = 4;
+  }
+  */
+
+  std::size_t compressed_size =
+      llvm::protobuf::getVarIntFieldSize(1, traceCompression) +
+      llvm::protobuf::getVarIntFieldSize(2, buffer.size()) +
+      llvm::protobuf::getStringFieldSize(3, compressedTrace.size());
+  if (chunkIndex > 0)
+    compressed_size += llvm::protobuf::getVarIntFieldSize(4, chunkIndex);
+
+  // repeated CompressedTrace compressed_traces = 2;
+  llvm::protobuf::saveStringHeader(OutputOS, 2, compressed_size);
+  llvm::protobuf::saveVarInt(OutputOS, 1, traceCompression); // format
+  llvm::protobuf::saveVarInt(OutputOS, 2, buffer.size());    // size
+  llvm::protobuf::saveString(OutputOS, 3,
+                             llvm::toStringRef(compressedTrace)); // data
+  // The chunk number is repeated outside of the compressed header, such that
+  // the traces can be told apart without decompressing them.
+  if (chunkIndex > 0)
+    llvm::protobuf::saveVarInt(OutputOS, 4, chunkIndex); // chunk
+}
+
+void TemplightProtobufWriter::writeFrame() {
+  buffer.insert(headerSize, dictionaryBuffer);
+  dictionaryBuffer.clear();
+  headerSize = 0;
+
+  /*
+  message TemplightTraceCollection {
+    repeated fixed64 sync_markers = 5;
+    repeated bytes trace_frames = 6;
+  }
+  */
+
+  std::uint32_t checksum = llvm::crc32(llvm::arrayRefFromStringRef(buffer));
+  // repeated fixed64 sync_markers = 5;
+  llvm::protobuf::saveFixed64(OutputOS, 5,
+                              (std::uint64_t(checksum) << 32) |
+                                  FrameSyncMagic);
+  // repeated bytes trace_frames = 6;
+  llvm::protobuf::saveString(OutputOS, 6, buffer);
+  OutputOS.flush();
+  buffer.clear();
+
+  // The deltas start over in each frame, such that the time-stamps after a
+  // lost frame are still right.
+  lastTimeStamp = 0;
+  lastMemoryUsage = 0;
+}
+
+void TemplightProtobufWriter::setTraceCompression(bool aCompress,
+                                                  int aLevel) {
+  traceCompression = 0;
+  traceCompressionLevel = aLevel;
+  if (!aCompress)
+    return;
+  // Prefer zstd, which is both faster and better than zlib.
+  if (llvm::compression::zstd::isAvailable())
+    traceCompression = 2;
+  else if (llvm::compression::zlib::isAvailable())
+    traceCompression = 1;
+  else
+    llvm::errs() << "Warning: [Templight-Writer] LLVM was built without zstd "
+                    "or zlib, the trace will not be compressed.\n";
+}
+
+void TemplightProtobufWriter::flushChunk() {
+  writeTrace();
+  OutputOS.flush();
+
+  // NOTE: The file and name dictionaries carry over to the next chunk, and
+  // the buffer keeps its capacity, such that memory usage stays flat.
+  buffer.clear();
+  ++chunkIndex;
+  printHeader();
+}
+
+void TemplightProtobufWriter::initialize(const std::string &aSourceName) {
+  sourceName = aSourceName;
+  chunkIndex = 0;
+  depth = 0;
+  indexedChunks.clear();
+  indexedTrees.clear();
+  firstChunkTree = 0;
+  if (traceFrames) {
+    // The frames are written as they come, uncompressed and unindexed.
+    chunkSize = 0;
+    traceCompression = 0;
+    traceIndex = false;
+  }
+  printHeader();
+  if (traceFrames)
+    writeFrame();
 }
 
 void TemplightProtobufWriter::finalize() {
-  // repeated TemplightTrace traces = 1;
-  llvm::protobuf::saveString(OutputOS, 1, buffer);
+  if (traceFrames) {
+    if (!buffer.empty() || !dictionaryBuffer.empty())
+      writeFrame();
+    return;
+  }
+  // A tree that never ended (e.g., after a fatal error) runs to the end.
+  if (traceIndex && (depth > 0) && (firstChunkTree < indexedTrees.size()))
+    indexedTrees.back().Size = buffer.size() - indexedTrees.back().Offset;
+  writeTrace();
+  buffer.clear();
+  if (traceIndex)
+    writeIndex();
 }
 
-std::string
-TemplightProtobufWriter::printEntryLocation(const std::string &FileName,
-                                            int Line, int Column) {
+void TemplightProtobufWriter::writeIndex() {
+  std::vector<llvm::StringRef> file_names(fileNameMap.size());
+  for (const auto &F : fileNameMap)
+    file_names[F.second] = F.first;
 
   /*
+  message TraceIndex {
+    message Chunk {
+      required uint64 offset = 1;
+      required uint64 names_offset = 2;
+      required uint64 names_size = 3;
+    }
+    message Tree {
+      required uint32 chunk = 1;
+      required uint64 offset = 2;
+      required uint64 size = 3;
+      optional double time_stamp = 4;
+      optional double duration = 5;
+      optional sint64 base_time = 6;
+      optional uint64 base_memory = 7;
+    }
+    repeated Chunk chunks = 1;
+    repeated Tree trees = 2;
+    repeated string file_names = 3;
+  }
+  */
+
+  // NOTE: All the offsets go backwards from the index, such that the index
+  // still holds when the trace is appended to other data (e.g., other
+  // traces), as long as nothing comes after it.
+  std::uint64_t index_position = OutputOS.tell();
+  std::string index_contents;
+  llvm::raw_string_ostream OS(index_contents);
+  std::string sub_contents;
+  for (const IndexedChunk &C : indexedChunks) {
+    sub_contents.clear();
+    llvm::raw_string_ostream OS_sub(sub_contents);
+    llvm::protobuf::saveVarInt(OS_sub, 1,
+                               index_position - C.Offset); // offset
+    llvm::protobuf::saveVarInt(OS_sub, 2, C.NamesOffset); // names_offset
+    llvm::protobuf::saveVarInt(OS_sub, 3, C.NamesSize);   // names_size
+    OS_sub.flush();
+    llvm::protobuf::saveString(OS, 1, sub_contents); // chunks
+  }
+  for (const IndexedTree &T : indexedTrees) {
+    sub_contents.clear();
+    llvm::raw_string_ostream OS_sub(sub_contents);
+    llvm::protobuf::saveVarInt(OS_sub, 1, T.Chunk);     // chunk
+    llvm::protobuf::saveVarInt(OS_sub, 2, T.Offset);    // offset
+    llvm::protobuf::saveVarInt(OS_sub, 3, T.Size);      // size
+    llvm::protobuf::saveDouble(OS_sub, 4, T.TimeStamp); // time_stamp
+    llvm::protobuf::saveDouble(OS_sub, 5, T.Duration);  // duration
+    if (traceVersion >= 2) {
+      llvm::protobuf::saveSInt(OS_sub, 6, T.BaseTime);    // base_time
+      llvm::protobuf::saveVarInt(OS_sub, 7, T.BaseMemory); // base_memory
+    }
+    OS_sub.flush();
+    llvm::protobuf::saveString(OS, 2, sub_contents); // trees
+  }
+  for (llvm::StringRef FileName : file_names)
+    llvm::protobuf::saveString(OS, 3, FileName); // file_names
+  OS.flush();
+
+  // The index is found from the end of the output, through its size.
+  std::uint64_t index_offset =
+      llvm::protobuf::getStringFieldSize(3, index_contents.size());
+  // optional TraceIndex index = 3;
+  llvm::protobuf::saveString(OutputOS, 3, index_contents);
+  // optional fixed64 index_offset = 4;
+  llvm::protobuf::saveFixed64(OutputOS, 4, index_offset);
+  OutputOS.flush();
+}
+
+struct TemplightProtobufWriter::EntryLocation {
+  llvm::StringRef FileName; // only written the first time a file appears.
+  std::size_t FileId;
+  int Line;
+  int Column;
+
+  std::size_t getSize() const {
+    return (FileName.empty()
+                ? 0
+                : llvm::protobuf::getStringFieldSize(1, FileName.size())) +
+           llvm::protobuf::getVarIntFieldSize(2, FileId) +
+           llvm::protobuf::getVarIntFieldSize(3, Line) +
+           llvm::protobuf::getVarIntFieldSize(4, Column);
+  }
+
+  void save(llvm::raw_ostream &OS) const {
+
+    /*
   message SourceLocation {
     optional string file_name = 1;
     required uint32 file_id = 2;
     required uint32 line = 3;
     optional uint32 column = 4;
   }
-  */
+    */
 
-  std::string location_contents;
-  llvm::raw_string_ostream OS_inner(location_contents);
+    if (!FileName.empty())
+      llvm::protobuf::saveString(OS, 1, FileName); // file_name
+    llvm::protobuf::saveVarInt(OS, 2, FileId);     // file_id
+    llvm::protobuf::saveVarInt(OS, 3, Line);       // line
+    llvm::protobuf::saveVarInt(OS, 4, Column);     // column
+  }
+};
 
+void TemplightProtobufWriter::getEntryLocation(const std::string &FileName,
+                                               int Line, int Column,
+                                               EntryLocation &Loc) {
   std::unordered_map<std::string, std::size_t>::iterator it =
       fileNameMap.find(FileName);
 
   if (it == fileNameMap.end()) {
-    llvm::protobuf::saveString(OS_inner, 1, FileName); // file_name
-    std::size_t file_id = fileNameMap.size();
-    llvm::protobuf::saveVarInt(OS_inner, 2, file_id); // file_id
-    fileNameMap[FileName] = file_id;
+    Loc.FileName = FileName;
+    Loc.FileId = fileNameMap.size();
+    fileNameMap[FileName] = Loc.FileId;
   } else {
-    llvm::protobuf::saveVarInt(OS_inner, 2, it->second); // file_id
+    Loc.FileName = llvm::StringRef();
+    Loc.FileId = it->second;
   }
+  Loc.Line = Line;
+  Loc.Column = Column;
+}
 
-  llvm::protobuf::saveVarInt(OS_inner, 3, Line);   // line
-  llvm::protobuf::saveVarInt(OS_inner, 4, Column); // column
+static const std::size_t no_pos = ~std::size_t(0);
+
+// Checks if the '<', '>' or ',' at position i is part of an operator name
+// (e.g., "operator<", "operator<<", "operator->" or "operator,").
+static bool isOperatorName(llvm::StringRef Name, std::size_t Lo,
+                           std::size_t i) {
+  static const char *const LessSuffixes[] = {"", "<"};
+  static const char *const GreaterSuffixes[] = {"", ">", "-", "<="};
+  static const char *const CommaSuffixes[] = {""};
+  llvm::ArrayRef<const char *> Suffixes;
+  switch (Name[i]) {
+  case '<':
+    Suffixes = LessSuffixes;
+    break;
+  case '>':
+    Suffixes = GreaterSuffixes;
+    break;
+  default:
+    Suffixes = CommaSuffixes;
+    break;
+  }
+  llvm::StringRef Prefix = Name.slice(Lo, i);
+  for (const char *Suffix : Suffixes) {
+    llvm::StringRef Rest = Prefix;
+    if (!Rest.consume_back(Suffix) || !Rest.consume_back("operator"))
+      continue;
+    if (Rest.empty() || !(llvm::isAlnum(Rest.back()) || Rest.back() == '_'))
+      return true;
+  }
+  return false;
+}
 
-  OS_inner.str();
+void TemplightProtobufWriter::pushNameFrame(std::size_t Lo) {
+  NameFrame F;
+  F.Lo = F.LitLo = F.SegLo = Lo;
+  F.OpenPos = no_pos;
+  F.PrefixId = no_pos;
+  F.FirstPiece = namePieces.size();
+  F.ParenDepth = 0;
+  F.HasMarkers = false;
+  nameFrames.push_back(F);
+}
 
-  return location_contents; // NRVO
+void TemplightProtobufWriter::addNameMarker(NameFrame &F, std::size_t Lo,
+                                            std::size_t Hi, std::size_t Id) {
+  if (F.LitLo < Lo)
+    namePieces.push_back({F.LitLo, Lo, false});
+  namePieces.push_back({Id, 0, true});
+  F.LitLo = Hi;
+  F.HasMarkers = true;
 }
 
-static void trimSpaces(std::string::iterator &it,
-                       std::string::iterator &it_end) {
-  while (it < it_end) {
-    if (*it == ' ')
-      ++it;
-    else if (*it_end == ' ')
-      --it_end;
+std::size_t TemplightProtobufWriter::internNamePieces(llvm::StringRef Name,
+                                                      std::size_t FirstPiece) {
+  std::size_t marked_size = 0;
+  for (std::size_t i = FirstPiece; i < namePieces.size(); ++i)
+    marked_size +=
+        (namePieces[i].IsMarker ? 1 : namePieces[i].Hi - namePieces[i].Lo);
+
+  /*
+  message DictionaryEntry {
+    required string marked_name = 1;
+    repeated uint32 marker_ids = 2;
+  }
+  */
+  nameScratch.clear();
+  llvm::raw_svector_ostream OS_dict(nameScratch);
+  llvm::protobuf::saveStringHeader(OS_dict, 1, marked_size); // marked_name
+  for (std::size_t i = FirstPiece; i < namePieces.size(); ++i) {
+    if (namePieces[i].IsMarker)
+      OS_dict << '\0';
     else
-      break;
+      OS_dict << Name.slice(namePieces[i].Lo, namePieces[i].Hi);
+  }
+  for (std::size_t i = FirstPiece; i < namePieces.size(); ++i) {
+    if (namePieces[i].IsMarker)
+      llvm::protobuf::saveVarInt(OS_dict, 2, namePieces[i].Lo); // marker_ids
+  }
+  namePieces.resize(FirstPiece);
+
+  return internDictionaryEntry();
+}
+
+std::size_t TemplightProtobufWriter::internDictionaryEntry() {
+  // NOTE: The encoded entry is its own key, since the entries that have the
+  // same marked name and markers are necessarily the same name.
+  std::pair<llvm::StringMap<std::size_t, llvm::BumpPtrAllocator>::iterator,
+            bool>
+      Res = dictionaryEntryMap.try_emplace(nameScratch.str(),
+                                           dictionaryEntryMap.size());
+  if (Res.second) {
+    llvm::raw_string_ostream OS_outer(dictionaryBuffer);
+    // repeated DictionaryEntry names = 3;
+    llvm::protobuf::saveString(OS_outer, 3, nameScratch.str());
+  }
+  return Res.first->second;
+}
+
+std::size_t TemplightProtobufWriter::internLeafName(llvm::StringRef Name,
+                                                    std::size_t Lo,
+                                                    std::size_t Hi) {
+  namePieces.push_back({Lo, Hi, false});
+  return internNamePieces(Name, namePieces.size() - 1);
+}
+
+std::size_t TemplightProtobufWriter::finishNameFrame(llvm::StringRef Name,
+                                                     NameFrame &F,
+                                                     std::size_t Lo,
+                                                     std::size_t Hi) {
+  if (!F.HasMarkers) {
+    namePieces.resize(F.FirstPiece);
+    return internLeafName(Name, Lo, Hi);
+  }
+  if ((F.SegLo != no_pos) && (F.SegLo < Hi))
+    addNameMarker(F, F.SegLo, Hi, internLeafName(Name, F.SegLo, Hi));
+  if (F.LitLo < Hi)
+    namePieces.push_back({F.LitLo, Hi, false});
+  return internNamePieces(Name, F.FirstPiece);
+}
+
+void TemplightProtobufWriter::closeNameArgument(llvm::StringRef Name,
+                                                std::size_t i) {
+  NameFrame F = nameFrames.back();
+  nameFrames.pop_back();
+
+  // Trim the spaces around the argument:
+  std::size_t Lo = (F.Lo == no_pos ? i : F.Lo);
+  std::size_t Hi = i;
+  while ((Hi > Lo) && (Name[Hi - 1] == ' '))
+    --Hi;
+  std::size_t Id = finishNameFrame(Name, F, Lo, Hi);
+
+  NameFrame &P = nameFrames.back();
+  if (P.PrefixId != no_pos) {
+    addNameMarker(P, P.SegLo, P.OpenPos, P.PrefixId);
+    P.PrefixId = no_pos;
   }
-  ++it_end;
+  P.SegLo = no_pos;
+  addNameMarker(P, Lo, Hi, Id);
 }
 
 std::size_t
-TemplightProtobufWriter::createDictionaryEntry(const std::string &NameOrig) {
-  std::unordered_map<std::string, std::size_t>::iterator it_found =
-      templateNameMap.find(NameOrig);
+TemplightProtobufWriter::createDictionaryEntry(const std::string &Name) {
+  llvm::StringMap<std::size_t, llvm::BumpPtrAllocator>::iterator it_found =
+      templateNameMap.find(Name);
   if (it_found != templateNameMap.end())
     return it_found->second;
 
-  // FIXME: Convert this code to being constructive of "Name", instead of
-  // destructive (replacing sub-strings with '\0' characters).
-  std::string Name = NameOrig;
-  std::string::iterator it_open = Name.end();
-  std::string::iterator it_colon_lo = Name.begin();
-  int srch_state = 0;
-  llvm::SmallVector<std::size_t, 8> markers;
-  for (std::string::iterator it = Name.begin(); it != Name.end(); ++it) {
-    switch (srch_state) {
-    case 0:
-      if (*it == '<') {
-        // check for "operator<<", "operator<" and "operator<="
-        llvm::StringRef test_str(Name.data(), it - Name.begin() + 1);
-        if (test_str.ends_with("operator<")) {
-          it_open = Name.end();
-          srch_state = 0;
-        } else {
-          it_open = it;
-          ++srch_state;
-        }
-      } else if ((*it == ':') && (it + 1 < Name.end()) && (*(it + 1) == ':')) {
-        if (it_colon_lo < it) {
-          markers.push_back(
-              createDictionaryEntry(std::string(it_colon_lo, it)));
-          std::size_t offset_lo = it_colon_lo - Name.begin();
-          Name.replace(it_colon_lo, it, 1, '\0');
-          it = Name.begin() + offset_lo + 2;
-        } else {
-          it += 1;
-        }
-        it_colon_lo = it + 1;
-        it_open = Name.end();
+  // Tokenize the name in a single pass, with a frame for each template
+  // argument being read. A component is interned as soon as it is complete
+  // and replaced by a marker in the frame that contains it, so no part of
+  // the name is copied or hashed more than once.
+  namePieces.clear();
+  nameFrames.clear();
+  pushNameFrame(0);
+  for (std::size_t i = 0; i < Name.size(); ++i) {
+    NameFrame &F = nameFrames.back();
+    char c = Name[i];
+    if (F.Lo == no_pos) {
+      if (c == ' ')
+        continue; // skip the spaces before an argument.
+      F.Lo = F.LitLo = F.SegLo = i;
+    }
+    if (F.ParenDepth > 0) {
+      // Nothing is split within parentheses (function types, lambdas, ...).
+      if (c == '(')
+        ++F.ParenDepth;
+      else if (c == ')')
+        --F.ParenDepth;
+      continue;
+    }
+    switch (c) {
+    case '(':
+      ++F.ParenDepth;
+      break;
+    case ':':
+      if ((i + 1 < Name.size()) && (Name[i + 1] == ':')) {
+        if (F.SegLo < i)
+          addNameMarker(F, F.SegLo, i, internLeafName(Name, F.SegLo, i));
+        F.SegLo = i + 2;
+        ++i;
       }
       break;
-    case 1:
-      if (*it == '<') {
-        // check for "operator<<" and "operator<"
-        llvm::StringRef test_str(Name.data(), it - Name.begin() + 1);
-        if (test_str.ends_with("operator<<<")) {
-          it_open = it;
-          srch_state = 1;
-        } else {
-          ++srch_state;
-        }
-      } else if ((*it == ',') || (*it == '>')) {
-        if (it_colon_lo < it_open) {
-          std::size_t offset_end = it - it_open;
-          std::size_t offset_lo = it_colon_lo - Name.begin();
-          markers.push_back(
-              createDictionaryEntry(std::string(it_colon_lo, it_open)));
-          Name.replace(it_colon_lo, it_open, 1, '\0');
-          it_open = Name.begin() + offset_lo + 1;
-          it = it_open + offset_end;
-          it_colon_lo = Name.end();
-        }
-        std::string::iterator it_lo = it_open + 1;
-        std::string::iterator it_hi = it - 1;
-        trimSpaces(it_lo, it_hi);
-        // Create or find the marker entry:
-        markers.push_back(createDictionaryEntry(std::string(it_lo, it_hi)));
-        std::size_t offset_end = it - it_hi;
-        std::size_t offset_lo = it_lo - Name.begin();
-        Name.replace(it_lo, it_hi, 1, '\0');
-        it = Name.begin() + offset_lo + 1 + offset_end;
-        it_open = it;
-        it_colon_lo = Name.end();
-        if (*it == '>') {
-          it_open = Name.end();
-          srch_state = 0;
-          it_colon_lo = it + 1;
-        }
+    case '<':
+      if (isOperatorName(Name, F.Lo, i))
+        break;
+      F.OpenPos = i;
+      if (F.SegLo < i)
+        F.PrefixId = internLeafName(Name, F.SegLo, i);
+      pushNameFrame(no_pos);
+      break;
+    case ',':
+    case '>':
+      if ((nameFrames.size() == 1) || isOperatorName(Name, F.Lo, i))
+        break;
+      closeNameArgument(Name, i);
+      if (c == ',') {
+        pushNameFrame(no_pos);
+      } else {
+        nameFrames.back().OpenPos = no_pos;
+        nameFrames.back().SegLo = i + 1;
       }
       break;
     default:
-      if (*it == '<') {
-        ++srch_state;
-      } else if (*it == '>') {
-        --srch_state;
-      }
       break;
     }
   }
-  if (!markers.empty() && it_colon_lo != Name.end()) {
-    markers.push_back(
-        createDictionaryEntry(std::string(it_colon_lo, Name.end())));
-    Name.replace(it_colon_lo, Name.end(), 1, '\0');
-  }
 
-  /*
-  message DictionaryEntry {
-    required string marked_name = 1;
-    repeated uint32 marker_ids = 2;
+  if (nameFrames.size() > 1) {
+    // An argument list was left open, keep it as it is written.
+    namePieces.resize(nameFrames[1].FirstPiece);
+    nameFrames.resize(1);
   }
-  */
-  std::string dict_entry;
-  llvm::raw_string_ostream OS_dict(dict_entry);
-  llvm::protobuf::saveString(OS_dict, 1, Name); // marked_name
-  for (llvm::SmallVector<std::size_t, 8>::iterator mk = markers.begin(),
-                                                   mk_end = markers.end();
-       mk != mk_end; ++mk) {
-    llvm::protobuf::saveVarInt(OS_dict, 2, *mk); // marker_ids
-  }
-  OS_dict.str();
-
-  std::size_t id = templateNameMap.size();
-  templateNameMap[NameOrig] = id;
-
-  llvm::raw_string_ostream OS_outer(buffer);
-  // repeated DictionaryEntry names = 3;
-  llvm::protobuf::saveString(OS_outer, 3, dict_entry);
+  std::size_t id = finishNameFrame(Name, nameFrames.front(), 0, Name.size());
 
+  templateNameMap.try_emplace(Name, id);
   return id;
 }
 
-std::string
-TemplightProtobufWriter::printTemplateName(const std::string &Name) {
+void TemplightProtobufWriter::getEntryDeltas(double TimeStamp,
+                                             std::uint64_t MemoryUsage,
+                                             std::int64_t &TimeDelta,
+                                             std::int64_t &MemoryDelta) {
+  // NOTE: The deltas are taken from the rounded nanoseconds, such that the
+  // rounding errors do not accumulate from one entry to the next.
+  std::int64_t TimeStampNS = std::llround(TimeStamp * 1e9);
+  TimeDelta = TimeStampNS - lastTimeStamp;
+  MemoryDelta = std::int64_t(MemoryUsage - lastMemoryUsage);
+  lastTimeStamp = TimeStampNS;
+  lastMemoryUsage = MemoryUsage;
+}
 
-  /*
+struct TemplightProtobufWriter::EntryTemplateName {
+  unsigned int Tag; // 1: name, 2: compressed_name or 3: dict_id.
+  llvm::StringRef Bytes;
+  std::size_t DictId;
+
+  std::size_t getSize() const {
+    if (Tag == 3)
+      return llvm::protobuf::getVarIntFieldSize(3, DictId);
+    return llvm::protobuf::getStringFieldSize(Tag, Bytes.size());
+  }
+
+  void save(llvm::raw_ostream &OS) const {
+
+    /*
   message TemplateName {
     optional string name = 1;
     optional bytes compressed_name = 2;
+    optional uint32 dict_id = 3;
   }
-  */
+    */
 
-  std::string tname_contents;
-  llvm::raw_string_ostream OS_inner(tname_contents);
+    if (Tag == 3)
+      llvm::protobuf::saveVarInt(OS, 3, DictId); // dict_id
+    else
+      llvm::protobuf::saveString(OS, Tag, Bytes); // name or compressed_name
+  }
+};
 
+void TemplightProtobufWriter::getTemplateName(const std::string &Name,
+                                              EntryTemplateName &TName) {
   switch (compressionMode) {
-  case 1: { // zlib-compressed name:
-    llvm::SmallVector<uint8_t, 32> CompressedBuffer;
+  case 1: // zlib-compressed name:
     llvm::compression::zlib::compress(llvm::arrayRefFromStringRef(Name),
-                                      CompressedBuffer);
-    // optional bytes compressed_name = 2;
-    llvm::protobuf::saveString(OS_inner, 2,
-                               llvm::toStringRef(CompressedBuffer));
+                                      compressedName);
+    TName.Tag = 2;
+    TName.Bytes = llvm::toStringRef(compressedName);
     break;
-  }
-    LLVM_FALLTHROUGH;
   case 0:
-    // optional string name = 1;
-    llvm::protobuf::saveString(OS_inner, 1, Name); // name
+    TName.Tag = 1;
+    TName.Bytes = Name;
     break;
   case 2:
   default:
-    // optional uint32 dict_id = 3;
-    llvm::protobuf::saveVarInt(OS_inner, 3, createDictionaryEntry(Name));
+    TName.Tag = 3;
+    TName.DictId = createDictionaryEntry(Name);
     break;
   }
+}
+
+void TemplightProtobufWriter::printDictionaryEntry(
+    const PrintableTemplightDictionaryEntry &aEntry) {
 
-  OS_inner.str();
+  /*
+  message DictionaryEntry {
+    required string marked_name = 1;
+    repeated uint32 marker_ids = 2;
+  }
+  */
 
-  return tname_contents; // NRVO
+  nameScratch.clear();
+  llvm::raw_svector_ostream OS_dict(nameScratch);
+  llvm::protobuf::saveString(OS_dict, 1, aEntry.MarkedName); // marked_name
+  for (std::size_t MarkerId : aEntry.MarkerIds)
+    llvm::protobuf::saveVarInt(OS_dict, 2,
+                               structuralIds[MarkerId]); // marker_ids
+
+  // NOTE: The entries of the tracer are merged with the ones created from
+  // printed names, so they are renumbered along the way.
+  if (structuralIds.size() <= aEntry.Id)
+    structuralIds.resize(aEntry.Id + 1, no_pos);
+  structuralIds[aEntry.Id] = internDictionaryEntry();
 }
 
 void TemplightProtobufWriter::printEntry(
     const PrintableTemplightEntryBegin &aEntry) {
+  if (traceIndex && (depth == 0))
+    indexedTrees.push_back({chunkIndex, buffer.size(), 0, aEntry.TimeStamp,
+                            0.0, lastTimeStamp, lastMemoryUsage});
+
+  // NOTE: The names and files are looked up first, because new dictionary
+  // entries are written out before the entry that uses them.
+  EntryTemplateName TName;
+  if (aEntry.DictionaryId < structuralIds.size()) {
+    TName.Tag = 3;
+    TName.DictId = structuralIds[aEntry.DictionaryId];
+  } else {
+    getTemplateName(aEntry.Name, TName);
+  }
+  EntryLocation Loc;
+  getEntryLocation(aEntry.FileName, aEntry.Line, aEntry.Column, Loc);
+  EntryLocation OriLoc;
+  bool HasOrigin = !aEntry.TempOri_FileName.empty();
+  if (HasOrigin)
+    getEntryLocation(aEntry.TempOri_FileName, aEntry.TempOri_Line,
+                     aEntry.TempOri_Column, OriLoc);
+  std::int64_t TimeDelta = 0;
+  std::int64_t MemoryDelta = 0;
+  if (traceVersion >= 2)
+    getEntryDeltas(aEntry.TimeStamp, aEntry.MemoryUsage, TimeDelta,
+                   MemoryDelta);
 
-  std::string entry_contents;
-  {
-    llvm::raw_string_ostream OS_inner(entry_contents);
-
-    /*
+  /*
   message Begin {
     required SynthesisKind kind = 1;
-    required string name = 2;
+    required TemplateName name = 2;
     required SourceLocation location = 3;
     optional double time_stamp = 4;
     optional uint64 memory_usage = 5;
     optional SourceLocation template_origin = 6;
+    optional sint64 time_delta = 7;
+    optional sint64 memory_delta = 8;
   }
-    */
+  */
 
-    llvm::protobuf::saveVarInt(OS_inner, 1, aEntry.SynthesisKind); // kind
-    llvm::protobuf::saveString(OS_inner, 2,
-                               printTemplateName(aEntry.Name)); // name
-    llvm::protobuf::saveString(OS_inner, 3,
-                               printEntryLocation(aEntry.FileName, aEntry.Line,
-                                                  aEntry.Column)); // location
-    llvm::protobuf::saveDouble(OS_inner, 4, aEntry.TimeStamp);     // time_stamp
+  std::size_t begin_size =
+      llvm::protobuf::getVarIntFieldSize(1, aEntry.SynthesisKind) +
+      llvm::protobuf::getStringFieldSize(2, TName.getSize()) +
+      llvm::protobuf::getStringFieldSize(3, Loc.getSize());
+  if (traceVersion >= 2) {
+    if (TimeDelta != 0)
+      begin_size += llvm::protobuf::getSIntFieldSize(7, TimeDelta);
+    if (MemoryDelta != 0)
+      begin_size += llvm::protobuf::getSIntFieldSize(8, MemoryDelta);
+  } else {
+    begin_size += llvm::protobuf::getDoubleFieldSize(4);
     if (aEntry.MemoryUsage > 0)
-      llvm::protobuf::saveVarInt(OS_inner, 5,
-                                 aEntry.MemoryUsage); // memory_usage
-    if (!aEntry.TempOri_FileName.empty())
-      llvm::protobuf::saveString(
-          OS_inner, 6,
-          printEntryLocation(aEntry.TempOri_FileName, aEntry.TempOri_Line,
-                             aEntry.TempOri_Column)); // template_origin
+      begin_size += llvm::protobuf::getVarIntFieldSize(5, aEntry.MemoryUsage);
   }
+  if (HasOrigin)
+    begin_size += llvm::protobuf::getStringFieldSize(6, OriLoc.getSize());
 
-  std::string oneof_contents;
-  {
-    llvm::raw_string_ostream OS_inner(oneof_contents);
+  llvm::raw_string_ostream OS(buffer);
 
-    /*
+  // repeated TemplightEntry entries = 2;
+  llvm::protobuf::saveStringHeader(
+      OS, 2, llvm::protobuf::getStringFieldSize(1, begin_size));
+
+  /*
   oneof begin_or_end {
     Begin begin = 1;
     End end = 2;
   }
-     */
+  */
 
-    llvm::protobuf::saveString(OS_inner, 1, entry_contents); // begin
-  }
+  llvm::protobuf::saveStringHeader(OS, 1, begin_size); // begin
 
-  llvm::raw_string_ostream OS(buffer);
+  llvm::protobuf::saveVarInt(OS, 1, aEntry.SynthesisKind);  // kind
+  llvm::protobuf::saveStringHeader(OS, 2, TName.getSize()); // name
+  TName.save(OS);
+  llvm::protobuf::saveStringHeader(OS, 3, Loc.getSize()); // location
+  Loc.save(OS);
+  if (traceVersion < 2) {
+    llvm::protobuf::saveDouble(OS, 4, aEntry.TimeStamp); // time_stamp
+    if (aEntry.MemoryUsage > 0)
+      llvm::protobuf::saveVarInt(OS, 5, aEntry.MemoryUsage); // memory_usage
+  }
+  if (HasOrigin) {
+    llvm::protobuf::saveStringHeader(OS, 6,
+                                     OriLoc.getSize()); // template_origin
+    OriLoc.save(OS);
+  }
+  if (traceVersion >= 2) {
+    if (TimeDelta != 0)
+      llvm::protobuf::saveSInt(OS, 7, TimeDelta); // time_delta
+    if (MemoryDelta != 0)
+      llvm::protobuf::saveSInt(OS, 8, MemoryDelta); // memory_delta
+  }
+  OS.flush();
 
-  // repeated TemplightEntry entries = 2;
-  llvm::protobuf::saveString(OS, 2, oneof_contents);
+  ++depth;
+  if (traceFrames)
+    writeFrame();
 }
 
 void TemplightProtobufWriter::printEntry(
     const PrintableTemplightEntryEnd &aEntry) {
 
-  std::string entry_contents;
-  {
-    llvm::raw_string_ostream OS_inner(entry_contents);
+  std::int64_t TimeDelta = 0;
+  std::int64_t MemoryDelta = 0;
+  if (traceVersion >= 2)
+    getEntryDeltas(aEntry.TimeStamp, aEntry.MemoryUsage, TimeDelta,
+                   MemoryDelta);
 
-    /*
+  /*
   message End {
     optional double time_stamp = 1;
     optional uint64 memory_usage = 2;
+    optional double pruned_children_time = 3;
+    optional sint64 time_delta = 4;
+    optional sint64 memory_delta = 5;
   }
-    */
+  */
 
-    llvm::protobuf::saveDouble(OS_inner, 1, aEntry.TimeStamp); // time_stamp
+  std::size_t end_size = 0;
+  if (traceVersion >= 2) {
+    if (TimeDelta != 0)
+      end_size += llvm::protobuf::getSIntFieldSize(4, TimeDelta);
+    if (MemoryDelta != 0)
+      end_size += llvm::protobuf::getSIntFieldSize(5, MemoryDelta);
+  } else {
+    end_size += llvm::protobuf::getDoubleFieldSize(1);
     if (aEntry.MemoryUsage > 0)
-      llvm::protobuf::saveVarInt(OS_inner, 2,
-                                 aEntry.MemoryUsage); // memory_usage
+      end_size += llvm::protobuf::getVarIntFieldSize(2, aEntry.MemoryUsage);
   }
+  if (aEntry.PrunedChildrenTime > 0.0)
+    end_size += llvm::protobuf::getDoubleFieldSize(3);
 
-  std::string oneof_contents;
   {
-    llvm::raw_string_ostream OS_inner(oneof_contents);
+    llvm::raw_string_ostream OS(buffer);
+
+    // repeated TemplightEntry entries = 2;
+    llvm::protobuf::saveStringHeader(
+        OS, 2, llvm::protobuf::getStringFieldSize(2, end_size));
 
     /*
   oneof begin_or_end {
     Begin begin = 1;
     End end = 2;
   }
-     */
+    */
+
+    llvm::protobuf::saveStringHeader(OS, 2, end_size); // end
+
+    if (traceVersion < 2) {
+      llvm::protobuf::saveDouble(OS, 1, aEntry.TimeStamp); // time_stamp
+      if (aEntry.MemoryUsage > 0)
+        llvm::protobuf::saveVarInt(OS, 2, aEntry.MemoryUsage); // memory_usage
+    }
+    if (aEntry.PrunedChildrenTime > 0.0)
+      llvm::protobuf::saveDouble(
+          OS, 3, aEntry.PrunedChildrenTime); // pruned_children_time
+    if (traceVersion >= 2) {
+      if (TimeDelta != 0)
+        llvm::protobuf::saveSInt(OS, 4, TimeDelta); // time_delta
+      if (MemoryDelta != 0)
+        llvm::protobuf::saveSInt(OS, 5, MemoryDelta); // memory_delta
+    }
+  }
 
-    llvm::protobuf::saveString(OS_inner, 2, entry_contents); // end
+  if (depth > 0) {
+    --depth;
+    if (traceIndex && (depth == 0)) {
+      IndexedTree &T = indexedTrees.back();
+      T.Size = buffer.size() - T.Offset;
+      T.Duration = aEntry.TimeStamp - T.TimeStamp;
+    }
   }
+  if (traceFrames) {
+    writeFrame();
+    return;
+  }
+  // Only cut chunks between top-level instantiations, such that each chunk
+  // holds complete instantiation trees.
+  if ((chunkSize > 0) && (depth == 0) &&
+      (buffer.size() + dictionaryBuffer.size() >= chunkSize))
+    flushChunk();
+}
+
+void TemplightProtobufWriter::printSummary(
+    const PrintableTemplightSummaryEntry &aEntry) {
+  EntryTemplateName TName;
+  getTemplateName(aEntry.Name, TName);
+  EntryLocation Loc;
+  bool HasLocation = !aEntry.FileName.empty();
+  if (HasLocation)
+    getEntryLocation(aEntry.FileName, aEntry.Line, aEntry.Column, Loc);
+
+  /*
+  message TemplightSummary {
+    required TemplightEntry.SynthesisKind kind = 1;
+    required TemplightEntry.TemplateName name = 2;
+    optional TemplightEntry.SourceLocation location = 3;
+    required uint64 count = 4;
+    optional double inclusive_time = 5;
+    optional double exclusive_time = 6;
+    optional uint32 max_depth = 7;
+  }
+  */
+
+  std::size_t summary_size =
+      llvm::protobuf::getVarIntFieldSize(1, aEntry.SynthesisKind) +
+      llvm::protobuf::getStringFieldSize(2, TName.getSize()) +
+      llvm::protobuf::getVarIntFieldSize(4, aEntry.Count) +
+      llvm::protobuf::getDoubleFieldSize(5) +
+      llvm::protobuf::getDoubleFieldSize(6) +
+      llvm::protobuf::getVarIntFieldSize(7, aEntry.MaxDepth);
+  if (HasLocation)
+    summary_size += llvm::protobuf::getStringFieldSize(3, Loc.getSize());
 
   llvm::raw_string_ostream OS(buffer);
 
-  // repeated TemplightEntry entries = 2;
-  llvm::protobuf::saveString(OS, 2, oneof_contents);
+  // repeated TemplightSummary summaries = 4;
+  llvm::protobuf::saveStringHeader(OS, 4, summary_size);
+
+  llvm::protobuf::saveVarInt(OS, 1, aEntry.SynthesisKind);  // kind
+  llvm::protobuf::saveStringHeader(OS, 2, TName.getSize()); // name
+  TName.save(OS);
+  if (HasLocation) {
+    llvm::protobuf::saveStringHeader(OS, 3, Loc.getSize()); // location
+    Loc.save(OS);
+  }
+  llvm::protobuf::saveVarInt(OS, 4, aEntry.Count);         // count
+  llvm::protobuf::saveDouble(OS, 5, aEntry.InclusiveTime); // inclusive_time
+  llvm::protobuf::saveDouble(OS, 6, aEntry.ExclusiveTime); // exclusive_time
+  llvm::protobuf::saveVarInt(OS, 7, aEntry.MaxDepth);      // max_depth
+  OS.flush();
+
+  if (traceFrames)
+    writeFrame();
 }
 
 } // namespace clang
@@ -13,102 +13,498 @@
 #include "TemplightEntryPrinter.h"
 #include "TemplightProtobufWriter.h"
 
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclTemplate.h>
 #include <clang/Basic/FileManager.h>
 #include <clang/Basic/SourceManager.h>
 #include <clang/Sema/Sema.h>
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Config/llvm-config.h>
 #include <llvm/Support/Format.h>
 #include <llvm/Support/Process.h>
 #include <llvm/Support/Timer.h>
 #include <llvm/Support/YAMLTraits.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <ctime>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) ||            \
+    defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define TEMPLIGHT_HAS_CYCLE_COUNTER 1
+#elif defined(__aarch64__)
+#define TEMPLIGHT_HAS_CYCLE_COUNTER 1
+#endif
+
 namespace clang {
 
 namespace {
 
+using Seconds = std::chrono::duration<double, std::ratio<1>>;
+
+double getRUsageTimeStamp() {
+  // NOTE: Use this function because it produces time since start of process.
+  llvm::sys::TimePoint<> now;
+  std::chrono::nanoseconds user, sys;
+  llvm::sys::Process::GetTimeUsage(now, user, sys);
+  if (user != std::chrono::nanoseconds::zero())
+    now = llvm::sys::TimePoint<>(user);
+  return Seconds(now.time_since_epoch()).count();
+}
+
+double getMonotonicTimeStamp() {
+  // NOTE: On most platforms, this is serviced without a kernel round-trip.
+  return Seconds(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double getThreadCPUTimeStamp() {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+  struct timespec ts;
+  if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+    return double(ts.tv_sec) + double(ts.tv_nsec) * 1e-9;
+#endif
+  return getRUsageTimeStamp();
+}
+
+#ifdef TEMPLIGHT_HAS_CYCLE_COUNTER
+inline std::uint64_t readCycleCounter() {
+#if defined(__aarch64__)
+  std::uint64_t ticks;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return __rdtsc();
+#endif
+}
+#endif
+
+// Period of the busy-wait used to measure the frequency of the cycle counter.
+const std::chrono::milliseconds CycleCounterCalibrationPeriod(5);
+
 struct RawTemplightTraceEntry {
   bool IsTemplateBegin;
   std::size_t ParentBeginIdx;
+  std::size_t EndIdx; // for begin entries, the index of the matching end.
   Sema::CodeSynthesisContext::SynthesisKind SynthesisKind;
-  Decl *Entity;
+  unsigned EntityId;
   SourceLocation PointOfInstantiation;
   double TimeStamp;
   std::uint64_t MemoryUsage;
+  bool IsMemorySample;
+  double PrunedChildrenTime;
 
   static const std::size_t invalid_parent = ~std::size_t(0);
+  static const unsigned invalid_entity = ~0u;
 
   RawTemplightTraceEntry()
       : IsTemplateBegin(true), ParentBeginIdx(invalid_parent),
+        EndIdx(invalid_parent),
         SynthesisKind(Sema::CodeSynthesisContext::TemplateInstantiation),
-        Entity(0), TimeStamp(0.0), MemoryUsage(0){};
+        EntityId(invalid_entity), TimeStamp(0.0), MemoryUsage(0),
+        IsMemorySample(true), PrunedChildrenTime(0.0){};
 };
 
-PrintableTemplightEntryBegin
-rawToPrintableBegin(const Sema &TheSema, const RawTemplightTraceEntry &Entry) {
-  PrintableTemplightEntryBegin Ret;
+const std::size_t invalid_name_id = ~std::size_t(0);
 
-  Ret.SynthesisKind = Entry.SynthesisKind;
+// A dictionary of names built from the structure of the AST, instead of
+// parsing the names printed for diagnostics. The name of a declaration, of a
+// canonical type or of a template argument is interned once, and it refers to
+// the names that it is made of (scope, template and arguments) by their ids.
+class StructuralNameDictionary {
+public:
+  explicit StructuralNameDictionary(const Sema &aSema) : TheSema(aSema){};
+
+  std::size_t getDeclNameId(const NamedDecl *D) {
+    D = cast<NamedDecl>(D->getCanonicalDecl());
+    llvm::DenseMap<const Decl *, std::size_t>::iterator it = DeclIds.find(D);
+    if (it != DeclIds.end())
+      return it->second;
+
+    const NamedDecl *Template = nullptr;
+    const TemplateArgumentList *Args = nullptr;
+    if (const ClassTemplateSpecializationDecl *Spec =
+            dyn_cast<ClassTemplateSpecializationDecl>(D)) {
+      Template = Spec->getSpecializedTemplate();
+      Args = &Spec->getTemplateArgs();
+    } else if (const VarTemplateSpecializationDecl *Spec =
+                   dyn_cast<VarTemplateSpecializationDecl>(D)) {
+      Template = Spec->getSpecializedTemplate();
+      Args = &Spec->getTemplateArgs();
+    } else if (const FunctionDecl *FD = dyn_cast<FunctionDecl>(D)) {
+      Template = FD->getPrimaryTemplate();
+      Args = FD->getTemplateSpecializationArgs();
+    }
+
+    std::string MarkedName;
+    llvm::SmallVector<std::size_t, 8> MarkerIds;
+    if (Template && Args) {
+      MarkedName += '\0';
+      MarkerIds.push_back(getDeclNameId(Template));
+      MarkedName += '<';
+      for (const TemplateArgument &Arg : Args->asArray())
+        addArgumentNames(Arg, MarkedName, MarkerIds);
+      MarkedName += '>';
+    } else {
+      std::size_t ScopeId = getScopeNameId(D);
+      if (ScopeId != invalid_name_id) {
+        MarkedName += '\0';
+        MarkerIds.push_back(ScopeId);
+        MarkedName += "::";
+      }
+      std::string Name;
+      llvm::raw_string_ostream OS(Name);
+      D->getNameForDiagnostic(OS, TheSema.getPrintingPolicy(), false);
+      if (Name.empty())
+        Name = (isa<NamespaceDecl>(D) ? "(anonymous namespace)"
+                                      : "(anonymous)");
+      MarkedName += '\0';
+      MarkerIds.push_back(getLeafNameId(Name));
+    }
+
+    std::size_t Id = (MarkedName.size() == 1 ? MarkerIds.front()
+                                             : addEntry(MarkedName, MarkerIds));
+    DeclIds[D] = Id;
+    return Id;
+  };
+
+  // NOTE: A deque keeps the entries in place as it grows, such that the
+  // output thread can safely refer to them.
+  std::deque<PrintableTemplightDictionaryEntry> Entries;
+
+private:
+  std::size_t addEntry(const std::string &MarkedName,
+                       llvm::ArrayRef<std::size_t> MarkerIds) {
+    Entries.emplace_back();
+    PrintableTemplightDictionaryEntry &Entry = Entries.back();
+    Entry.Id = Entries.size() - 1;
+    Entry.MarkedName = MarkedName;
+    Entry.MarkerIds.assign(MarkerIds.begin(), MarkerIds.end());
+    return Entry.Id;
+  };
+
+  std::size_t getLeafNameId(llvm::StringRef Name) {
+    std::pair<llvm::StringMap<std::size_t>::iterator, bool> Res =
+        LeafIds.try_emplace(Name, Entries.size());
+    if (Res.second)
+      addEntry(Name.str(), {});
+    return Res.first->second;
+  };
+
+  std::size_t getScopeNameId(const NamedDecl *D) {
+    // NOTE: Like printed names, the inline namespaces are left out.
+    const DeclContext *DC = D->getDeclContext()->getRedeclContext();
+    while (const NamespaceDecl *NS = dyn_cast<NamespaceDecl>(DC)) {
+      if (!NS->isInline())
+        break;
+      DC = NS->getDeclContext()->getRedeclContext();
+    }
+    if (const NamedDecl *Scope = dyn_cast<NamedDecl>(DC))
+      return getDeclNameId(Scope);
+    return invalid_name_id;
+  };
+
+  std::size_t getTypeNameId(QualType T) {
+    T = TheSema.getASTContext().getCanonicalType(T);
+    llvm::DenseMap<const void *, std::size_t>::iterator it =
+        TypeIds.find(T.getAsOpaquePtr());
+    if (it != TypeIds.end())
+      return it->second;
+
+    // Classes and enums are named after their declaration, other types are
+    // printed as a whole.
+    std::size_t Id;
+    const TagType *Tag = dyn_cast<TagType>(T.getTypePtr());
+    if (Tag && !T.hasQualifiers()) {
+      Id = getDeclNameId(Tag->getDecl());
+    } else {
+      Id = getLeafNameId(T.getAsString(TheSema.getPrintingPolicy()));
+    }
+    TypeIds[T.getAsOpaquePtr()] = Id;
+    return Id;
+  };
 
-  NamedDecl *NamedTemplate = dyn_cast_or_null<NamedDecl>(Entry.Entity);
-  if (NamedTemplate) {
-    llvm::raw_string_ostream OS(Ret.Name);
+  void addArgumentNames(const TemplateArgument &Arg, std::string &MarkedName,
+                        llvm::SmallVectorImpl<std::size_t> &MarkerIds) {
+    std::size_t Id;
+    switch (Arg.getKind()) {
+    case TemplateArgument::Pack:
+      for (const TemplateArgument &Elem : Arg.pack_elements())
+        addArgumentNames(Elem, MarkedName, MarkerIds);
+      return;
+    case TemplateArgument::Type:
+      Id = getTypeNameId(Arg.getAsType());
+      break;
+    default: {
+      std::string Name;
+      llvm::raw_string_ostream OS(Name);
+      Arg.print(TheSema.getPrintingPolicy(), OS, /*IncludeType=*/true);
+      Id = getLeafNameId(Name);
+      break;
+    }
+    }
+    if (MarkedName.back() != '<')
+      MarkedName += ", ";
+    MarkedName += '\0';
+    MarkerIds.push_back(Id);
+  };
+
+  const Sema &TheSema;
+  llvm::StringMap<std::size_t> LeafIds;
+  llvm::DenseMap<const Decl *, std::size_t> DeclIds;
+  llvm::DenseMap<const void *, std::size_t> TypeIds;
+};
+
+// The information about an instantiated entity that does not change from one
+// trace entry to the next, resolved only once per entity.
+struct RawTemplightEntity {
+  Decl *Entity;
+  bool IsResolved;
+  bool IsBlacklisted;
+  std::string Name;
+  std::size_t NameId; // in the structural name dictionary, if used.
+  std::string TempOri_FileName;
+  int TempOri_Line;
+  int TempOri_Column;
+
+  explicit RawTemplightEntity(Decl *aEntity)
+      : Entity(aEntity), IsResolved(false), IsBlacklisted(false),
+        NameId(invalid_name_id),
+        TempOri_Line(0), TempOri_Column(0){};
+};
+
+void resolveRawEntity(const Sema &TheSema, RawTemplightEntity &Info,
+                      StructuralNameDictionary *Names, bool PrintName) {
+  NamedDecl *NamedTemplate = dyn_cast_or_null<NamedDecl>(Info.Entity);
+  if (NamedTemplate && Names)
+    Info.NameId = Names->getDeclNameId(NamedTemplate);
+  if (NamedTemplate && PrintName) {
+    llvm::raw_string_ostream OS(Info.Name);
     NamedTemplate->getNameForDiagnostic(OS, TheSema.getLangOpts(), true);
   }
 
-  PresumedLoc Loc =
-      TheSema.getSourceManager().getPresumedLoc(Entry.PointOfInstantiation);
-  if (!Loc.isInvalid()) {
-    Ret.FileName = Loc.getFilename();
-    Ret.Line = Loc.getLine();
-    Ret.Column = Loc.getColumn();
-  } else {
-    Ret.FileName = "";
-    Ret.Line = 0;
-    Ret.Column = 0;
+  if (Info.Entity) {
+    PresumedLoc Loc =
+        TheSema.getSourceManager().getPresumedLoc(Info.Entity->getLocation());
+    if (!Loc.isInvalid()) {
+      Info.TempOri_FileName = Loc.getFilename();
+      Info.TempOri_Line = Loc.getLine();
+      Info.TempOri_Column = Loc.getColumn();
+    }
   }
 
+  Info.IsResolved = true;
+}
+
+// A compact record of a trace entry that is ready to be printed. It only
+// refers to data that remains valid until the end of the trace (resolved
+// entities and file names owned by the source manager), such that it can be
+// handed over to the output thread as is.
+struct TemplightTraceEvent {
+  enum EventKind {
+    BeginEvent,
+    EndEvent,
+    SkipEvent,
+    DictionaryEvent,
+    StopEvent
+  };
+
+  EventKind Kind;
+  int SynthesisKind;
+  const RawTemplightEntity *Entity;
+  const PrintableTemplightDictionaryEntry *DictionaryEntry;
+  const char *FileName;
+  int Line;
+  int Column;
+  double TimeStamp;
+  std::uint64_t MemoryUsage;
+  double PrunedChildrenTime;
+
+  explicit TemplightTraceEvent(EventKind aKind = StopEvent)
+      : Kind(aKind), SynthesisKind(0), Entity(nullptr),
+        DictionaryEntry(nullptr), FileName(""), Line(0), Column(0),
+        TimeStamp(0.0), MemoryUsage(0), PrunedChildrenTime(0.0){};
+};
+
+TemplightTraceEvent rawToTraceEvent(const Sema &TheSema,
+                                    const RawTemplightTraceEntry &Entry,
+                                    const RawTemplightEntity *Info) {
+  TemplightTraceEvent Ret(Entry.IsTemplateBegin
+                              ? TemplightTraceEvent::BeginEvent
+                              : TemplightTraceEvent::EndEvent);
+
+  Ret.SynthesisKind = Entry.SynthesisKind;
+  Ret.Entity = Info;
   Ret.TimeStamp = Entry.TimeStamp;
   Ret.MemoryUsage = Entry.MemoryUsage;
+  Ret.PrunedChildrenTime = Entry.PrunedChildrenTime;
 
-  if (Entry.Entity) {
+  if (Entry.IsTemplateBegin) {
     PresumedLoc Loc =
-        TheSema.getSourceManager().getPresumedLoc(Entry.Entity->getLocation());
+        TheSema.getSourceManager().getPresumedLoc(Entry.PointOfInstantiation);
     if (!Loc.isInvalid()) {
-      Ret.TempOri_FileName = Loc.getFilename();
-      Ret.TempOri_Line = Loc.getLine();
-      Ret.TempOri_Column = Loc.getColumn();
-    } else {
-      Ret.TempOri_FileName = "";
-      Ret.TempOri_Line = 0;
-      Ret.TempOri_Column = 0;
+      Ret.FileName = Loc.getFilename();
+      Ret.Line = Loc.getLine();
+      Ret.Column = Loc.getColumn();
     }
   }
 
   return Ret;
 }
 
+void traceEventToPrintableBegin(const TemplightTraceEvent &Event,
+                                PrintableTemplightEntryBegin &Ret) {
+  // NOTE: Assigning into an existing printable entry re-uses the capacity of
+  // its strings, this avoids allocating new strings for every entry.
+  Ret.SynthesisKind = Event.SynthesisKind;
+  Ret.Name = Event.Entity->Name;
+  Ret.DictionaryId = Event.Entity->NameId;
+  Ret.FileName = Event.FileName;
+  Ret.Line = Event.Line;
+  Ret.Column = Event.Column;
+  Ret.TimeStamp = Event.TimeStamp;
+  Ret.MemoryUsage = Event.MemoryUsage;
+  Ret.TempOri_FileName = Event.Entity->TempOri_FileName;
+  Ret.TempOri_Line = Event.Entity->TempOri_Line;
+  Ret.TempOri_Column = Event.Entity->TempOri_Column;
+}
+
 PrintableTemplightEntryEnd
-rawToPrintableEnd(const Sema &TheSema, const RawTemplightTraceEntry &Entry) {
-  return {Entry.TimeStamp, Entry.MemoryUsage};
+traceEventToPrintableEnd(const TemplightTraceEvent &Event) {
+  return {Event.TimeStamp, Event.MemoryUsage, Event.PrunedChildrenTime};
 }
 
+// A bounded, lock-free queue between a single producer thread and a single
+// consumer thread.
+template <typename T> class SPSCRingBuffer {
+public:
+  // NOTE: The capacity must be a power of two.
+  explicit SPSCRingBuffer(std::size_t aCapacity)
+      : Slots(new T[aCapacity]), Mask(aCapacity - 1), Head(0), CachedTail(0),
+        Tail(0), CachedHead(0){};
+
+  bool tryPush(const T &Item) {
+    std::size_t Pos = Tail.load(std::memory_order_relaxed);
+    if (Pos - CachedHead > Mask) {
+      CachedHead = Head.load(std::memory_order_acquire);
+      if (Pos - CachedHead > Mask)
+        return false;
+    }
+    Slots[Pos & Mask] = Item;
+    Tail.store(Pos + 1, std::memory_order_release);
+    return true;
+  };
+
+  bool tryPop(T &Item) {
+    std::size_t Pos = Head.load(std::memory_order_relaxed);
+    if (Pos == CachedTail) {
+      CachedTail = Tail.load(std::memory_order_acquire);
+      if (Pos == CachedTail)
+        return false;
+    }
+    Item = Slots[Pos & Mask];
+    Head.store(Pos + 1, std::memory_order_release);
+    return true;
+  };
+
+private:
+  std::unique_ptr<T[]> Slots;
+  std::size_t Mask;
+
+  // Keep the positions owned by each thread on separate cache lines.
+  alignas(64) std::atomic<std::size_t> Head;
+  std::size_t CachedTail; // consumer-side copy of Tail.
+  alignas(64) std::atomic<std::size_t> Tail;
+  std::size_t CachedHead; // producer-side copy of Head.
+};
+
+const std::size_t AsyncQueueCapacity = std::size_t(1) << 16;
+
+// Finds the template that an instantiated entity was generated from, such
+// that all the specializations of a template are aggregated together.
+const Decl *getPrimaryTemplateDecl(const Decl *D) {
+  if (!D)
+    return D;
+  if (const ClassTemplateSpecializationDecl *Spec =
+          dyn_cast<ClassTemplateSpecializationDecl>(D))
+    return Spec->getSpecializedTemplate();
+  if (const VarTemplateSpecializationDecl *Spec =
+          dyn_cast<VarTemplateSpecializationDecl>(D))
+    return Spec->getSpecializedTemplate();
+  if (const FunctionDecl *FD = dyn_cast<FunctionDecl>(D)) {
+    if (const FunctionTemplateDecl *Tmpl = FD->getPrimaryTemplate())
+      return Tmpl;
+    if (const FunctionDecl *Pattern = FD->getInstantiatedFromMemberFunction())
+      return Pattern;
+    return D;
+  }
+  if (const CXXRecordDecl *RD = dyn_cast<CXXRecordDecl>(D)) {
+    if (const CXXRecordDecl *Pattern = RD->getInstantiatedFromMemberClass())
+      return Pattern;
+  }
+  return D;
+}
+
+// The statistics accumulated for one template and kind of synthesis in
+// summary mode.
+struct TemplightSummaryAggregate {
+  const Decl *Template;
+  int SynthesisKind;
+  std::uint64_t Count;
+  double InclusiveTime;
+  double ExclusiveTime;
+  unsigned MaxDepth;
+  unsigned ActiveCount; // number of instantiations currently on the stack.
+
+  TemplightSummaryAggregate(const Decl *aTemplate, int aSynthesisKind)
+      : Template(aTemplate), SynthesisKind(aSynthesisKind), Count(0),
+        InclusiveTime(0.0), ExclusiveTime(0.0), MaxDepth(0),
+        ActiveCount(0){};
+};
+
+struct TemplightSummaryFrame {
+  unsigned AggregateIdx;
+  unsigned EntityId;
+  int SynthesisKind;
+  double StartTime;
+  double ChildrenTime;
+  double FilteredTime; // of the sub-trees left out, at any depth.
+
+  static const unsigned invalid_aggregate = ~0u;
+};
+
 } // unnamed namespace
 
 class TemplightTracer::TracePrinter : public TemplightEntryPrinter {
 public:
-  void skipRawEntry(const RawTemplightTraceEntry &Entry) { skipEntry(); }
+  void skipRawEntry(const RawTemplightTraceEntry &Entry) {
+    emitTraceEvent(TemplightTraceEvent(TemplightTraceEvent::SkipEvent));
+  }
 
   bool shouldIgnoreRawEntry(const RawTemplightTraceEntry &Entry) {
 
     // Avoid some duplication of memoization entries:
     if ((Entry.SynthesisKind == Sema::CodeSynthesisContext::Memoization) &&
-        LastClosedMemoization && (LastClosedMemoization == Entry.Entity)) {
+        (LastClosedMemoization != RawTemplightTraceEntry::invalid_entity) &&
+        (LastClosedMemoization == Entry.EntityId)) {
       return true;
     }
 
@@ -122,7 +518,7 @@ public:
          (CurrentParentBegin >= TraceEntries.size()) ||
          !((TraceEntries[CurrentParentBegin].SynthesisKind ==
             Entry.SynthesisKind) &&
-           (TraceEntries[CurrentParentBegin].Entity == Entry.Entity)))) {
+           (TraceEntries[CurrentParentBegin].EntityId == Entry.EntityId)))) {
       return true; // ignore end entries that don't match the current begin
                    // entry.
     }
@@ -137,24 +533,329 @@ public:
       skipRawEntry(
           Entry); // recursively skip all entries until end of this one.
     } else {
+      const RawTemplightEntity *Info = nullptr;
       if (Entry.IsTemplateBegin) {
-        printEntry(rawToPrintableBegin(TheSema, Entry));
-      } else {
-        printEntry(rawToPrintableEnd(TheSema, Entry));
+        Info = &getEntity(Entry.EntityId);
+        emitDictionaryEntries();
       }
+      emitTraceEvent(rawToTraceEvent(TheSema, Entry, Info));
     }
   };
 
+  void printTraceEvent(const TemplightTraceEvent &Event) {
+    switch (Event.Kind) {
+    case TemplightTraceEvent::BeginEvent:
+      traceEventToPrintableBegin(Event, PrintableBegin);
+      printEntry(PrintableBegin);
+      break;
+    case TemplightTraceEvent::EndEvent:
+      printEntry(traceEventToPrintableEnd(Event));
+      break;
+    case TemplightTraceEvent::SkipEvent:
+      skipEntry();
+      break;
+    case TemplightTraceEvent::DictionaryEvent:
+      printDictionaryEntry(*Event.DictionaryEntry);
+      break;
+    default:
+      break;
+    }
+  };
+
+  void emitTraceEvent(const TemplightTraceEvent &Event) {
+    if (!AsyncQueue) {
+      printTraceEvent(Event);
+      return;
+    }
+    while (!AsyncQueue->tryPush(Event))
+      std::this_thread::yield(); // the output thread is lagging behind.
+    // NOTE: The fence orders the push before reading the flag, against the
+    // opposite order in the output thread, such that either it sees the new
+    // event or it is woken up.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (AsyncOutputWaiting.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> Lock(AsyncOutputMutex);
+      AsyncOutputWakeUp.notify_one();
+    }
+  };
+
+  void emitDictionaryEntries() {
+    // The new entries of the dictionary go out before the entry using them.
+    for (; NextDictionaryEntry < Names.Entries.size(); ++NextDictionaryEntry) {
+      TemplightTraceEvent Event(TemplightTraceEvent::DictionaryEvent);
+      Event.DictionaryEntry = &Names.Entries[NextDictionaryEntry];
+      emitTraceEvent(Event);
+    }
+  };
+
+  void runAsyncOutput() {
+    TemplightTraceEvent Event;
+    unsigned IdleRounds = 0;
+    while (true) {
+      if (!AsyncQueue->tryPop(Event)) {
+        // Spin a little while the compiler produces no entries, and then wait
+        // to be woken up by the next one.
+        if (++IdleRounds < 64) {
+          std::this_thread::yield();
+          continue;
+        }
+        std::unique_lock<std::mutex> Lock(AsyncOutputMutex);
+        AsyncOutputWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        AsyncOutputWakeUp.wait(Lock,
+                               [&] { return AsyncQueue->tryPop(Event); });
+        AsyncOutputWaiting.store(false, std::memory_order_relaxed);
+      }
+      IdleRounds = 0;
+      if (Event.Kind == TemplightTraceEvent::StopEvent)
+        return;
+      printTraceEvent(Event);
+    }
+  };
+
+  void startAsyncOutput() {
+#if LLVM_ENABLE_THREADS
+    AsyncQueue.reset(
+        new SPSCRingBuffer<TemplightTraceEvent>(AsyncQueueCapacity));
+    AsyncOutput = std::thread([this] { runAsyncOutput(); });
+#else
+    llvm::errs() << "Warning: [Templight-Tracer] Asynchronous output requires "
+                    "threads, the trace will be printed synchronously.\n";
+#endif
+  };
+
+  void stopAsyncOutput() {
+    if (!AsyncQueue)
+      return;
+    emitTraceEvent(TemplightTraceEvent(TemplightTraceEvent::StopEvent));
+    AsyncOutput.join();
+    AsyncQueue.reset();
+  };
+
   void printCachedRawEntries() {
-    for (std::vector<RawTemplightTraceEntry>::iterator it =
-             TraceEntries.begin();
-         it != TraceEntries.end(); ++it)
-      printOrSkipEntry(*it);
+    for (std::size_t i = 0; i < TraceEntries.size(); ++i) {
+      RawTemplightTraceEntry &Entry = TraceEntries[i];
+      if ((MinDuration > 0.0) && Entry.IsTemplateBegin &&
+          (Entry.EndIdx != RawTemplightTraceEntry::invalid_parent)) {
+        double Duration =
+            TraceEntries[Entry.EndIdx].TimeStamp - Entry.TimeStamp;
+        if (Duration < MinDuration) {
+          // Drop the whole sub-tree, but keep its time in the parent entry.
+          std::size_t Parent = Entry.ParentBeginIdx;
+          if ((Parent != RawTemplightTraceEntry::invalid_parent) &&
+              (TraceEntries[Parent].EndIdx !=
+               RawTemplightTraceEntry::invalid_parent))
+            TraceEntries[TraceEntries[Parent].EndIdx].PrunedChildrenTime +=
+                Duration;
+          i = Entry.EndIdx;
+          continue;
+        }
+      }
+      printOrSkipEntry(Entry);
+    }
     TraceEntries.clear();
     CurrentParentBegin = RawTemplightTraceEntry::invalid_parent;
   };
 
+  std::uint64_t readMemoryUsage() const {
+    switch (MemorySource) {
+    case ASTMemory: {
+      const ASTContext &Context = TheSema.getASTContext();
+      return Context.getASTAllocatedMemory() +
+             Context.getSideTableAllocatedMemory() +
+             TheSema.BumpAlloc.getTotalMemory();
+    }
+    case MallocMemory:
+    default:
+      return llvm::sys::Process::GetMallocUsage();
+    }
+  };
+
+  void interpolateMemoryUsage(double TimeStamp, std::uint64_t MemoryUsage) {
+    // Spread the change of memory since the last sample linearly (in time)
+    // over the entries that were recorded without reading the memory.
+    double TimeSpan = TimeStamp - LastMemorySampleTime;
+    double MemorySpan = double(MemoryUsage) - double(LastMemorySample);
+    for (std::size_t i = FirstUnsampledEntry; i < TraceEntries.size(); ++i) {
+      double Ratio = 0.0;
+      if (TimeSpan > 0.0)
+        Ratio = (TraceEntries[i].TimeStamp - LastMemorySampleTime) / TimeSpan;
+      Ratio = std::min(std::max(Ratio, 0.0), 1.0);
+      TraceEntries[i].MemoryUsage =
+          std::uint64_t(double(LastMemorySample) + Ratio * MemorySpan);
+    }
+    LastMemorySample = MemoryUsage;
+    LastMemorySampleTime = TimeStamp;
+    FirstUnsampledEntry = TraceEntries.size();
+  };
+
+  void sampleMemoryUsage(RawTemplightTraceEntry &Entry, bool Force) {
+    Entry.IsMemorySample =
+        Force || ((MemorySampleInterval == 0.0) && (MemorySampleEvents == 0)) ||
+        ((MemorySampleEvents != 0) &&
+         (++EventsSinceMemorySample >= MemorySampleEvents)) ||
+        ((MemorySampleInterval != 0.0) &&
+         (Entry.TimeStamp - LastMemorySampleTime >= MemorySampleInterval));
+    if (!Entry.IsMemorySample) {
+      Entry.MemoryUsage = LastMemorySample;
+      return;
+    }
+    Entry.MemoryUsage = readMemoryUsage();
+    interpolateMemoryUsage(Entry.TimeStamp, Entry.MemoryUsage);
+    EventsSinceMemorySample = 0;
+  };
+
+  void flushMemorySamples() {
+    // The cached entries are about to be printed, the ones recorded since the
+    // last sample are interpolated up to a fresh one.
+    if (MemoryFlag && (FirstUnsampledEntry < TraceEntries.size()))
+      interpolateMemoryUsage(TraceEntries.back().TimeStamp, readMemoryUsage());
+    FirstUnsampledEntry = 0;
+  };
+
+  void recordSummaryEntry(const RawTemplightTraceEntry &Entry) {
+    // Avoid some duplication of memoization entries:
+    if ((Entry.SynthesisKind == Sema::CodeSynthesisContext::Memoization) &&
+        (LastClosedMemoization != RawTemplightTraceEntry::invalid_entity) &&
+        (LastClosedMemoization == Entry.EntityId))
+      return;
+
+    if (Entry.IsTemplateBegin) {
+      TemplightSummaryFrame Frame;
+      Frame.AggregateIdx = TemplightSummaryFrame::invalid_aggregate;
+      Frame.EntityId = Entry.EntityId;
+      Frame.SynthesisKind = Entry.SynthesisKind;
+      Frame.StartTime = Entry.TimeStamp;
+      Frame.ChildrenTime = 0.0;
+      Frame.FilteredTime = 0.0;
+
+      // Like skipped entries in a trace, the instantiations from system
+      // headers, or matching the blacklists, are left out along with
+      // everything they instantiate.
+      bool IsSkipped =
+          (!SummaryStack.empty() &&
+           (SummaryStack.back().AggregateIdx ==
+            TemplightSummaryFrame::invalid_aggregate)) ||
+          (IgnoreSystemFlag && !Entry.PointOfInstantiation.isInvalid() &&
+           TheSema.getSourceManager().isInSystemHeader(
+               Entry.PointOfInstantiation)) ||
+          (hasBlacklists() && getEntity(Entry.EntityId).IsBlacklisted);
+      if (!IsSkipped) {
+        Frame.AggregateIdx = getSummaryAggregate(Entry);
+        TemplightSummaryAggregate &Agg = SummaryAggregates[Frame.AggregateIdx];
+        ++Agg.Count;
+        ++Agg.ActiveCount;
+        Agg.MaxDepth =
+            std::max(Agg.MaxDepth, unsigned(SummaryStack.size() + 1));
+      }
+      SummaryStack.push_back(Frame);
+      LastClosedMemoization = RawTemplightTraceEntry::invalid_entity;
+      return;
+    }
+
+    // ignore end entries that don't match the current begin entry.
+    if (SummaryStack.empty() ||
+        (SummaryStack.back().SynthesisKind != Entry.SynthesisKind) ||
+        (SummaryStack.back().EntityId != Entry.EntityId))
+      return;
+
+    TemplightSummaryFrame Frame = SummaryStack.back();
+    SummaryStack.pop_back();
+    if (Entry.SynthesisKind == Sema::CodeSynthesisContext::Memoization)
+      LastClosedMemoization = Entry.EntityId;
+
+    double Duration = Entry.TimeStamp - Frame.StartTime;
+    if (Frame.AggregateIdx == TemplightSummaryFrame::invalid_aggregate) {
+      // The time of a sub-tree left out is taken out of the times of the
+      // instantiations above it, as if it had not been traced.
+      if (!SummaryStack.empty() &&
+          (SummaryStack.back().AggregateIdx !=
+           TemplightSummaryFrame::invalid_aggregate)) {
+        SummaryStack.back().ChildrenTime += Duration;
+        SummaryStack.back().FilteredTime += Duration;
+      }
+      return;
+    }
+
+    TemplightSummaryAggregate &Agg = SummaryAggregates[Frame.AggregateIdx];
+    Agg.ExclusiveTime += Duration - Frame.ChildrenTime;
+    // NOTE: Only the outermost of recursive instantiations of a template
+    // counts towards its inclusive time, to avoid counting it twice.
+    if (--Agg.ActiveCount == 0)
+      Agg.InclusiveTime += Duration - Frame.FilteredTime;
+    if (!SummaryStack.empty()) {
+      SummaryStack.back().ChildrenTime += Duration;
+      SummaryStack.back().FilteredTime += Frame.FilteredTime;
+    }
+  };
+
+  unsigned getSummaryAggregate(const RawTemplightTraceEntry &Entry) {
+    const Decl *Template =
+        getPrimaryTemplateDecl(getEntity(Entry.EntityId).Entity);
+    std::pair<llvm::DenseMap<std::pair<const Decl *, int>, unsigned>::iterator,
+              bool>
+        Res = SummaryIds.try_emplace(
+            std::make_pair(Template, int(Entry.SynthesisKind)),
+            SummaryAggregates.size());
+    if (Res.second)
+      SummaryAggregates.push_back(
+          TemplightSummaryAggregate(Template, Entry.SynthesisKind));
+    return Res.first->second;
+  };
+
+  void printSummaryEntries() {
+    PrintableTemplightSummaryEntry Summary;
+    for (std::vector<TemplightSummaryAggregate>::iterator it =
+             SummaryAggregates.begin();
+         it != SummaryAggregates.end(); ++it) {
+      Summary.SynthesisKind = it->SynthesisKind;
+      Summary.Name.clear();
+      Summary.FileName.clear();
+      Summary.Line = 0;
+      Summary.Column = 0;
+      if (const NamedDecl *NamedTemplate =
+              dyn_cast_or_null<NamedDecl>(it->Template)) {
+        llvm::raw_string_ostream OS(Summary.Name);
+        NamedTemplate->getNameForDiagnostic(OS, TheSema.getLangOpts(), true);
+      }
+      if (it->Template) {
+        PresumedLoc Loc = TheSema.getSourceManager().getPresumedLoc(
+            it->Template->getLocation());
+        if (!Loc.isInvalid()) {
+          Summary.FileName = Loc.getFilename();
+          Summary.Line = Loc.getLine();
+          Summary.Column = Loc.getColumn();
+        }
+      }
+      Summary.Count = it->Count;
+      Summary.InclusiveTime = it->InclusiveTime;
+      Summary.ExclusiveTime = it->ExclusiveTime;
+      Summary.MaxDepth = it->MaxDepth;
+      printSummary(Summary);
+    }
+    SummaryAggregates.clear();
+    SummaryIds.clear();
+  };
+
   void printRawEntry(RawTemplightTraceEntry Entry, bool inSafeMode = false) {
+    if (SummaryFlag) {
+      recordSummaryEntry(Entry);
+      return;
+    }
+
+    // NOTE: The memory is sampled before the entry is filtered out, such that
+    // all samples feed the interpolation. The end of a top-level entry is
+    // always sampled, since the cached entries are printed right after it.
+    // Entries printed in safe-mode cannot be revisited, they simply keep the
+    // last memory sample.
+    if (MemoryFlag)
+      sampleMemoryUsage(Entry, !Entry.IsTemplateBegin &&
+                                   !TraceEntries.empty() &&
+                                   (Entry.SynthesisKind ==
+                                    TraceEntries.front().SynthesisKind) &&
+                                   (Entry.EntityId ==
+                                    TraceEntries.front().EntityId));
+
     if (shouldIgnoreRawEntry(Entry))
       return;
 
@@ -168,32 +869,61 @@ public:
       CurrentParentBegin = TraceEntries.size();
     } else { // note: this point should not be reached if CurrentParentBegin is
              // not valid.
+      TraceEntries[CurrentParentBegin].EndIdx = TraceEntries.size();
       Entry.ParentBeginIdx = TraceEntries[CurrentParentBegin].ParentBeginIdx;
       CurrentParentBegin = Entry.ParentBeginIdx;
     };
     TraceEntries.push_back(Entry);
+    if (Entry.IsMemorySample)
+      FirstUnsampledEntry = TraceEntries.size();
 
     if (Entry.IsTemplateBegin)
-      LastClosedMemoization = nullptr;
+      LastClosedMemoization = RawTemplightTraceEntry::invalid_entity;
     if (!Entry.IsTemplateBegin &&
         (Entry.SynthesisKind == Sema::CodeSynthesisContext::Memoization))
-      LastClosedMemoization = Entry.Entity;
+      LastClosedMemoization = Entry.EntityId;
 
     if (!Entry.IsTemplateBegin &&
         (Entry.SynthesisKind == TraceEntries.front().SynthesisKind) &&
-        (Entry.Entity ==
+        (Entry.EntityId ==
          TraceEntries.front()
-             .Entity)) { // did we reach the end of the top-level begin entry?
+             .EntityId)) { // did we reach the end of the top-level begin entry?
       if (!inSafeMode) { // if not in safe-mode, print out the cached entries.
         printCachedRawEntries();
       } else { // if in safe-mode, simply clear the cached entries.
         TraceEntries.clear();
         CurrentParentBegin = RawTemplightTraceEntry::invalid_parent;
       }
+      FirstUnsampledEntry = 0;
+    }
+  };
+
+  unsigned internEntity(Decl *Entity) {
+    // NOTE: Entries without an entity keep the invalid id, such that they are
+    // never taken for a repeated memoization of the same entity.
+    if (!Entity)
+      return RawTemplightTraceEntry::invalid_entity;
+    std::pair<llvm::DenseMap<const Decl *, unsigned>::iterator, bool> Res =
+        EntityIds.try_emplace(Entity, Entities.size());
+    if (Res.second)
+      Entities.push_back(RawTemplightEntity(Entity));
+    return Res.first->second;
+  };
+
+  const RawTemplightEntity &getEntity(unsigned EntityId) {
+    if (EntityId == RawTemplightTraceEntry::invalid_entity)
+      return NullEntity;
+    RawTemplightEntity &Info = Entities[EntityId];
+    // NOTE: The printed names are still needed to match the blacklists.
+    if (!Info.IsResolved) {
+      resolveRawEntity(TheSema, Info, StructuralNamesFlag ? &Names : nullptr,
+                       !StructuralNamesFlag || hasBlacklists());
+      Info.IsBlacklisted = isBlacklisted(Info.Name);
     }
+    return Info;
   };
 
-  void startTrace() {
+  void startTrace(bool Async = false, bool Summary = false) {
     // get the source name from the source manager:
     std::string src_name = "a";
     FileID fileID = TheSema.getSourceManager().getMainFileID();
@@ -203,29 +933,80 @@ public:
       src_name = file_ref->getName().str();
     }
     initialize(src_name);
+    SummaryFlag = Summary;
+    // NOTE: Once started, the output thread is the only one to use the
+    // entry printer, and it can only be told to skip or print entries.
+    if (Async)
+      startAsyncOutput();
   };
 
   void endTrace() {
+    if (SummaryFlag)
+      printSummaryEntries();
+    flushMemorySamples();
     printCachedRawEntries();
+    stopAsyncOutput();
     finalize();
   };
 
   TracePrinter(const Sema &aSema, const std::string &Output,
                bool IgnoreSystem = false)
       : TemplightEntryPrinter(Output), TheSema(aSema),
-        LastClosedMemoization(nullptr),
+        LastClosedMemoization(RawTemplightTraceEntry::invalid_entity),
         CurrentParentBegin(RawTemplightTraceEntry::invalid_parent),
-        IgnoreSystemFlag(IgnoreSystem){};
+        NullEntity(nullptr), AsyncOutputWaiting(false),
+        ProtobufWriter(nullptr), MinDuration(0.0), MemorySource(MallocMemory),
+        MemorySampleInterval(0.0), MemorySampleEvents(0),
+        EventsSinceMemorySample(0), FirstUnsampledEntry(0),
+        LastMemorySampleTime(0.0), LastMemorySample(0), Names(aSema),
+        NextDictionaryEntry(0), IgnoreSystemFlag(IgnoreSystem),
+        SummaryFlag(false), StructuralNamesFlag(false), MemoryFlag(false){};
 
-  ~TracePrinter(){};
+  ~TracePrinter() { stopAsyncOutput(); };
 
   const Sema &TheSema;
 
   std::vector<RawTemplightTraceEntry> TraceEntries;
-  Decl *LastClosedMemoization;
+  unsigned LastClosedMemoization;
   std::size_t CurrentParentBegin;
 
+  // NOTE: A deque keeps the resolved entities in place as it grows, such
+  // that the output thread can safely refer to them.
+  llvm::DenseMap<const Decl *, unsigned> EntityIds;
+  std::deque<RawTemplightEntity> Entities;
+  RawTemplightEntity NullEntity;
+  PrintableTemplightEntryBegin PrintableBegin;
+
+  std::unique_ptr<SPSCRingBuffer<TemplightTraceEvent>> AsyncQueue;
+  std::thread AsyncOutput;
+  std::mutex AsyncOutputMutex;
+  std::condition_variable AsyncOutputWakeUp;
+  std::atomic<bool> AsyncOutputWaiting;
+
+  TemplightProtobufWriter *ProtobufWriter; // owned by the entry printer.
+  double MinDuration;
+
+  // NOTE: The memory is only sampled and interpolated here, on the compiler
+  // thread, before the entries go out.
+  MemorySourceKind MemorySource;
+  double MemorySampleInterval;
+  unsigned MemorySampleEvents;
+  unsigned EventsSinceMemorySample;
+  std::size_t FirstUnsampledEntry;
+  double LastMemorySampleTime;
+  std::uint64_t LastMemorySample;
+
+  llvm::DenseMap<std::pair<const Decl *, int>, unsigned> SummaryIds;
+  std::vector<TemplightSummaryAggregate> SummaryAggregates;
+  std::vector<TemplightSummaryFrame> SummaryStack;
+
+  StructuralNameDictionary Names;
+  std::size_t NextDictionaryEntry;
+
   unsigned IgnoreSystemFlag : 1;
+  unsigned SummaryFlag : 1;
+  unsigned StructuralNamesFlag : 1;
+  unsigned MemoryFlag : 1;
 };
 
 void TemplightTracer::atTemplateBegin(const Sema &TheSema,
@@ -237,19 +1018,10 @@ void TemplightTracer::atTemplateBegin(const Sema &TheSema,
 
   Entry.IsTemplateBegin = true;
   Entry.SynthesisKind = Inst.Kind;
-  Entry.Entity = Inst.Entity;
+  Entry.EntityId = Printer->internEntity(Inst.Entity);
   Entry.PointOfInstantiation = Inst.PointOfInstantiation;
 
-  // NOTE: Use this function because it produces time since start of process.
-  llvm::sys::TimePoint<> now;
-  std::chrono::nanoseconds user, sys;
-  llvm::sys::Process::GetTimeUsage(now, user, sys);
-  if (user != std::chrono::nanoseconds::zero())
-    now = llvm::sys::TimePoint<>(user);
-
-  using Seconds = std::chrono::duration<double, std::ratio<1>>;
-  Entry.TimeStamp = Seconds(now.time_since_epoch()).count();
-  Entry.MemoryUsage = (MemoryFlag ? llvm::sys::Process::GetMallocUsage() : 0);
+  Entry.TimeStamp = getTimeStamp();
 
   Printer->printRawEntry(Entry, SafeModeFlag);
 }
@@ -263,25 +1035,75 @@ void TemplightTracer::atTemplateEnd(const Sema &TheSema,
 
   Entry.IsTemplateBegin = false;
   Entry.SynthesisKind = Inst.Kind;
-  Entry.Entity = Inst.Entity;
-
-  // NOTE: Use this function because it produces time since start of process.
-  llvm::sys::TimePoint<> now;
-  std::chrono::nanoseconds user, sys;
-  llvm::sys::Process::GetTimeUsage(now, user, sys);
-  if (user != std::chrono::nanoseconds::zero())
-    now = llvm::sys::TimePoint<>(user);
+  Entry.EntityId = Printer->internEntity(Inst.Entity);
 
-  using Seconds = std::chrono::duration<double, std::ratio<1>>;
-  Entry.TimeStamp = Seconds(now.time_since_epoch()).count();
-  Entry.MemoryUsage = (MemoryFlag ? llvm::sys::Process::GetMallocUsage() : 0);
+  Entry.TimeStamp = getTimeStamp();
 
   Printer->printRawEntry(Entry, SafeModeFlag);
 }
 
+double TemplightTracer::getTimeStamp() const {
+  switch (Clock) {
+  case MonotonicClock:
+    return getMonotonicTimeStamp();
+  case ThreadCPUTimeClock:
+    return getThreadCPUTimeStamp();
+  case TSCClock:
+#ifdef TEMPLIGHT_HAS_CYCLE_COUNTER
+    return CycleCounterBaseTime +
+           double(std::int64_t(readCycleCounter() - CycleCounterBase)) *
+               SecondsPerCycle;
+#else
+    return getMonotonicTimeStamp();
+#endif
+  case RUsageClock:
+  default:
+    return getRUsageTimeStamp();
+  }
+}
+
+void TemplightTracer::setMemorySampling(MemorySourceKind aSource,
+                                        unsigned IntervalUS, unsigned Events) {
+  if (!Printer)
+    return;
+  Printer->MemorySource = aSource;
+  Printer->MemorySampleInterval = IntervalUS * 1e-6;
+  Printer->MemorySampleEvents = Events;
+}
+
+void TemplightTracer::calibrateClock() {
+  if (Clock != TSCClock)
+    return;
+
+#ifdef TEMPLIGHT_HAS_CYCLE_COUNTER
+  // Measure the frequency of the cycle counter against the monotonic clock,
+  // such that converting a time-stamp is only a multiply-add afterwards.
+  std::chrono::steady_clock::time_point Start =
+      std::chrono::steady_clock::now();
+  std::uint64_t StartTicks = readCycleCounter();
+  std::chrono::steady_clock::time_point Stop = Start;
+  while (Stop - Start < CycleCounterCalibrationPeriod)
+    Stop = std::chrono::steady_clock::now();
+  std::uint64_t StopTicks = readCycleCounter();
+
+  if (StopTicks > StartTicks) {
+    CycleCounterBase = StopTicks;
+    CycleCounterBaseTime = Seconds(Stop.time_since_epoch()).count();
+    SecondsPerCycle = Seconds(Stop - Start).count() / (StopTicks - StartTicks);
+    return;
+  }
+#endif
+
+  llvm::errs() << "Warning: [Templight-Tracer] No usable cycle counter, "
+                  "falling back to the monotonic clock.\n";
+  Clock = MonotonicClock;
+}
+
 TemplightTracer::TemplightTracer(const Sema &TheSema, std::string Output,
                                  bool Memory, bool Safemode, bool IgnoreSystem)
-    : MemoryFlag(Memory), SafeModeFlag(Safemode) {
+    : MemoryFlag(Memory), SafeModeFlag(Safemode), AsyncFlag(false),
+      SummaryFlag(false), Clock(RUsageClock),
+      CycleCounterBase(0), CycleCounterBaseTime(0.0), SecondsPerCycle(0.0) {
 
   Printer.reset(
       new TemplightTracer::TracePrinter(TheSema, Output, IgnoreSystem));
@@ -294,8 +1116,10 @@ TemplightTracer::TemplightTracer(const Sema &TheSema, std::string Output,
     return;
   }
 
-  Printer->takeWriter(
-      new clang::TemplightProtobufWriter(*Printer->getTraceStream()));
+  Printer->MemoryFlag = MemoryFlag;
+  Printer->ProtobufWriter =
+      new clang::TemplightProtobufWriter(*Printer->getTraceStream());
+  Printer->takeWriter(Printer->ProtobufWriter);
 }
 
 TemplightTracer::~TemplightTracer() {
@@ -303,8 +1127,17 @@ TemplightTracer::~TemplightTracer() {
 }
 
 void TemplightTracer::initialize(const Sema &) {
+  bool Async = AsyncFlag && !SafeModeFlag && !SummaryFlag;
+  if (Async && (Clock == RUsageClock)) {
+    // The CPU-time of the process would include the output thread.
+    llvm::errs() << "Warning: [Templight-Tracer] The rusage clock counts the "
+                    "output thread, the thread-cputime clock will be used "
+                    "with asynchronous output.\n";
+    Clock = ThreadCPUTimeClock;
+  }
+  calibrateClock();
   if (Printer)
-    Printer->startTrace();
+    Printer->startTrace(Async, SummaryFlag);
 }
 
 void TemplightTracer::finalize(const Sema &) {
@@ -312,6 +1145,52 @@ void TemplightTracer::finalize(const Sema &) {
     Printer->endTrace();
 }
 
+void TemplightTracer::setStructuralNamesFlag(bool StructuralNames) {
+  if (Printer)
+    Printer->StructuralNamesFlag = StructuralNames;
+}
+
+bool TemplightTracer::getStructuralNamesFlag() const {
+  return Printer && Printer->StructuralNamesFlag;
+}
+
+void TemplightTracer::setMinDuration(unsigned DurationUS) {
+  if (Printer)
+    Printer->MinDuration = DurationUS * 1e-6;
+}
+
+void TemplightTracer::setChunkSize(unsigned ChunkSizeMB) {
+  if (Printer && Printer->ProtobufWriter)
+    Printer->ProtobufWriter->setChunkSize(std::size_t(ChunkSizeMB) << 20);
+}
+
+void TemplightTracer::setTraceVersion(unsigned Version) {
+  if ((Version < 1) || (Version > 2)) {
+    llvm::errs() << "Warning: [Templight-Tracer] Unknown trace version "
+                 << Version << ", version 1 will be used.\n";
+    Version = 1;
+  }
+  if (Printer && Printer->ProtobufWriter)
+    Printer->ProtobufWriter->setTraceVersion(Version);
+}
+
+void TemplightTracer::setTraceCompression(bool Compress, int Level) {
+  if (Printer && Printer->ProtobufWriter)
+    Printer->ProtobufWriter->setTraceCompression(Compress, Level);
+}
+
+void TemplightTracer::setTraceIndex(bool Index) {
+  if (Printer && Printer->ProtobufWriter)
+    Printer->ProtobufWriter->setTraceIndex(Index);
+}
+
+void TemplightTracer::setTraceFrames(bool Frames) {
+  if (Frames)
+    SafeModeFlag = true;
+  if (Printer && Printer->ProtobufWriter)
+    Printer->ProtobufWriter->setTraceFrames(Frames);
+}
+
 void TemplightTracer::readBlacklists(const std::string &BLFilename) {
   if (Printer)
     Printer->readBlacklists(BLFilename);
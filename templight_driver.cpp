@@ -86,6 +86,27 @@ static cl::opt<bool> MemoryProfile(
     cl::desc("Profile the memory usage during template instantiations."),
     cl::cat(ClangTemplightCategory));
 
+static cl::opt<TemplightTracer::MemorySourceKind> MemorySource(
+    "memory-source",
+    cl::desc("Select how the memory usage is measured with -memory."),
+    cl::values(clEnumValN(TemplightTracer::MallocMemory, "malloc",
+                          "Total heap usage of the process (default)."),
+               clEnumValN(TemplightTracer::ASTMemory, "ast",
+                          "Memory allocated by the AST context and Sema.")),
+    cl::init(TemplightTracer::MallocMemory), cl::cat(ClangTemplightCategory));
+
+static cl::opt<unsigned> MemorySampleInterval(
+    "memory-sample-interval",
+    cl::desc("With -memory, measure the memory at most once every <N> \n"
+             "microseconds, and interpolate the entries in between."),
+    cl::init(0), cl::cat(ClangTemplightCategory));
+
+static cl::opt<unsigned> MemorySampleEvents(
+    "memory-sample-events",
+    cl::desc("With -memory, measure the memory at most once every <N> \n"
+             "entries, and interpolate the entries in between."),
+    cl::init(0), cl::cat(ClangTemplightCategory));
+
 static cl::opt<bool> OutputInSafeMode(
     "safe-mode",
     cl::desc("Output Templight traces without buffering, \n"
@@ -93,6 +114,91 @@ static cl::opt<bool> OutputInSafeMode(
              "distort the timing profiles due to file I/O latency)."),
     cl::cat(ClangTemplightCategory));
 
+static cl::opt<bool> AsyncOutput(
+    "async",
+    cl::desc("Encode and write the traces on a separate thread, \n"
+             "to reduce the overhead seen by the compiler (ignored \n"
+             "in safe-mode). The rusage clock would count that \n"
+             "thread, the thread-cputime clock replaces it."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<bool> SummaryOutput(
+    "summary",
+    cl::desc("Aggregate the instantiations per template and only output \n"
+             "a summary of each template (count, inclusive and exclusive \n"
+             "time, maximum depth) instead of the full traces."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<unsigned> MinDuration(
+    "min-duration",
+    cl::desc("Drop the instantiations that took less than <N> \n"
+             "microseconds (with all their sub-instantiations) from \n"
+             "the traces, their time is kept in the parent entry \n"
+             "(ignored in safe-mode)."),
+    cl::init(0), cl::cat(ClangTemplightCategory));
+
+static cl::opt<unsigned> ChunkSize(
+    "chunk-size",
+    cl::desc("Write the traces to the output file in chunks of about \n"
+             "<N> MB, instead of keeping them in memory until the end \n"
+             "of the compilation (0 for a single chunk)."),
+    cl::init(0), cl::cat(ClangTemplightCategory));
+
+static cl::opt<unsigned> TraceVersion(
+    "trace-version",
+    cl::desc("Select the version of the trace format: 1 (default) \n"
+             "for absolute time-stamps and memory usage, or 2 for \n"
+             "compact deltas in integer nanoseconds and bytes."),
+    cl::init(1), cl::cat(ClangTemplightCategory));
+
+static cl::opt<bool> CompressOutput(
+    "compress",
+    cl::desc("Compress each chunk of the traces as a whole, with zstd \n"
+             "if LLVM supports it, or zlib otherwise."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<int> CompressLevel(
+    "compress-level",
+    cl::desc("Select the level of compression of the traces (0 for \n"
+             "the default level of the compression format)."),
+    cl::init(0), cl::cat(ClangTemplightCategory));
+
+static cl::opt<bool> TraceIndex(
+    "trace-index",
+    cl::desc("Append an index of the top-level instantiations to the \n"
+             "traces, to find the slowest ones without reading it all. \n"
+             "Its offsets are relative to the end of the trace, so only \n"
+             "the last trace of concatenated files is indexed, and the \n"
+             "files merged by the driver (one per source) are not."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<bool> TraceFrames(
+    "trace-frames",
+    cl::desc("Write each entry in a frame of its own, with a checksum, \n"
+             "to recover the traces of a crashed compilation (implies \n"
+             "-safe-mode, older readers cannot read these traces)."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<bool> StructuralNames(
+    "structural-names",
+    cl::desc("Build the dictionary of template names from the AST \n"
+             "(templates, canonical types and arguments) instead of \n"
+             "printing and parsing the name of each instantiation."),
+    cl::cat(ClangTemplightCategory));
+
+static cl::opt<TemplightTracer::ClockKind> ClockSource(
+    "clock", cl::desc("Select the clock used to time-stamp the traces."),
+    cl::values(clEnumValN(TemplightTracer::RUsageClock, "rusage",
+                          "User CPU-time of the process (default)."),
+               clEnumValN(TemplightTracer::MonotonicClock, "monotonic",
+                          "Wall-clock time from the monotonic clock."),
+               clEnumValN(TemplightTracer::ThreadCPUTimeClock,
+                          "thread-cputime",
+                          "CPU-time consumed by the compiler thread."),
+               clEnumValN(TemplightTracer::TSCClock, "tsc",
+                          "CPU cycle counter, calibrated at start-up.")),
+    cl::init(TemplightTracer::RUsageClock), cl::cat(ClangTemplightCategory));
+
 static cl::opt<bool>
     IgnoreSystemInst("ignore-system",
                      cl::desc("Ignore any template instantiation coming from \n"
@@ -123,8 +229,14 @@ static cl::opt<std::string> BlackListFilename(
     cl::cat(ClangTemplightCategory));
 
 static cl::Option *TemplightOptions[] = {
-    &OutputToStdOut, &MemoryProfile,    &OutputInSafeMode, &IgnoreSystemInst,
-    &InstProfiler,   &InteractiveDebug, &OutputFilename,   &BlackListFilename};
+    &OutputToStdOut,       &MemoryProfile,      &MemorySource,
+    &MemorySampleInterval, &MemorySampleEvents, &OutputInSafeMode,
+    &AsyncOutput,          &SummaryOutput,      &MinDuration,
+    &ChunkSize,            &TraceVersion,       &CompressOutput,
+    &CompressLevel,        &TraceIndex,         &TraceFrames,
+    &StructuralNames,      &ClockSource,        &IgnoreSystemInst,
+    &InstProfiler,         &InteractiveDebug,   &OutputFilename,
+    &BlackListFilename};
 
 void PrintTemplightHelp() {
   // Compute the maximum argument length...
@@ -445,7 +557,21 @@ static int ExecuteTemplightInvocation(CompilerInstance *Clang) {
   Act->InstProfiler = InstProfiler;
   Act->OutputToStdOut = OutputToStdOut;
   Act->MemoryProfile = MemoryProfile;
+  Act->MemorySource = MemorySource;
+  Act->MemorySampleInterval = MemorySampleInterval;
+  Act->MemorySampleEvents = MemorySampleEvents;
   Act->OutputInSafeMode = OutputInSafeMode;
+  Act->AsyncOutput = AsyncOutput;
+  Act->SummaryOutput = SummaryOutput;
+  Act->MinDuration = MinDuration;
+  Act->ChunkSize = ChunkSize;
+  Act->TraceVersion = TraceVersion;
+  Act->CompressOutput = CompressOutput;
+  Act->CompressLevel = CompressLevel;
+  Act->TraceIndex = TraceIndex;
+  Act->TraceFrames = TraceFrames;
+  Act->StructuralNames = StructuralNames;
+  Act->ClockSource = ClockSource;
   Act->IgnoreSystemInst = IgnoreSystemInst;
   Act->InteractiveDebug = InteractiveDebug;
   Act->BlackListFilename = BlackListFilename;
@@ -0,0 +1,387 @@
+#!/usr/bin/env python3
+"""Prints the entries of a templight protobuf trace, one per line, for the
+lit tests to check with FileCheck.
+
+  templight-dump.py [--no-times] [--check-times] [--dict-ids]
+                    [--memory-samples=N] trace.pbf
+
+Begin entries are printed as "begin <kind> <name> <file>:<line>:<column>",
+indented by their depth, and end entries as "end". Summaries are printed as
+"summary <kind> <name> count=<count> depth=<max-depth>". Unless --no-times is
+given, the time-stamps (or the inclusive and exclusive times) are appended, and
+the end entries of the instantiations whose sub-trees were pruned are followed
+by "pruned=<time>".
+With --check-times, the time-stamps must be positive and never decrease, the
+pruned time must fit in the entry, and the number of checked entries is
+printed at the end of each trace.
+With --dict-ids, the names that come from the dictionary, and each of the
+names they refer to, are followed by "#<id>".
+With --memory-samples=N, the memory was sampled at every N-th entry of each
+top-level instantiation and at its end, the other entries must be interpolated
+linearly (in time) between the samples around them, and the number of checked
+entries is printed at the end of each trace.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+KINDS = [
+    'TemplateInstantiation',
+    'DefaultTemplateArgumentInstantiation',
+    'DefaultFunctionArgumentInstantiation',
+    'ExplicitTemplateArgumentSubstitution',
+    'DeducedTemplateArgumentSubstitution',
+    'PriorTemplateArgumentSubstitution',
+    'DefaultTemplateArgumentChecking',
+    'ExceptionSpecEvaluation',
+    'ExceptionSpecInstantiation',
+    'DeclaringSpecialMember',
+    'DefiningSynthesizedFunction',
+    'Memoization',
+]
+
+
+def read_varint(buf, pos):
+    result = 0
+    shift = 0
+    while True:
+        byte = buf[pos]
+        pos += 1
+        result |= (byte & 0x7f) << shift
+        if not byte & 0x80:
+            return result, pos
+        shift += 7
+
+
+def read_fields(buf):
+    """Yields (field number, wire type, value) for each field of a message."""
+    pos = 0
+    while pos < len(buf):
+        key, pos = read_varint(buf, pos)
+        wire = key & 0x7
+        if wire == 0:
+            value, pos = read_varint(buf, pos)
+        elif wire == 1:
+            value = buf[pos:pos + 8]
+            pos += 8
+        elif wire == 2:
+            size, pos = read_varint(buf, pos)
+            value = buf[pos:pos + size]
+            pos += size
+        elif wire == 5:
+            value = buf[pos:pos + 4]
+            pos += 4
+        else:
+            raise ValueError('unsupported wire type %d' % wire)
+        yield key >> 3, wire, value
+
+
+def as_double(value):
+    return struct.unpack('<d', value)[0]
+
+
+def as_sint(value):
+    return (value >> 1) ^ -(value & 1)
+
+
+class TraceDumper(object):
+    def __init__(self, args):
+        self.args = args
+        self.failed = False
+        self.start_trace()
+
+    def start_trace(self):
+        self.version = 0
+        self.file_names = {}
+        self.names = []
+        self.depth = 0
+        self.begin_times = []
+        self.checked = 0
+        self.last_time = None
+        self.tree_entries = []
+        self.memory_checked = 0
+        # The tracer interpolates the first entries from zero.
+        self.last_sample = (0.0, 0)
+        self.reset_deltas()
+
+    def reset_deltas(self):
+        self.time_base = 0
+        self.memory_base = 0
+
+    def error(self, message):
+        print('error: ' + message)
+        self.failed = True
+
+    def finish_trace(self):
+        if self.args.check_times and self.version:
+            print('checked %d time-stamps' % self.checked)
+        if self.args.memory_samples and self.version:
+            print('checked %d memory usages' % self.memory_checked)
+
+    def expand_name(self, name_id):
+        marked, markers = self.names[name_id]
+        parts = marked.split('\0')
+        out = parts[0]
+        for marker, part in zip(markers, parts[1:]):
+            out += self.expand_name(marker)
+            if self.args.dict_ids:
+                out += '#%d' % marker
+            out += part
+        return out
+
+    def load_name(self, buf):
+        name = ''
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                name = value.decode('utf-8')
+            elif field == 2:
+                name = zlib.decompress(value).decode('utf-8')
+            elif field == 3 and value < len(self.names):
+                name = self.expand_name(value)
+                if self.args.dict_ids:
+                    name += '#%d' % value
+        return name
+
+    def load_location(self, buf):
+        file_name, file_id, line, column = None, None, 0, 0
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                file_name = value.decode('utf-8')
+            elif field == 2:
+                file_id = value
+            elif field == 3:
+                line = value
+            elif field == 4:
+                column = value
+        if file_id is not None:
+            if file_name is not None:
+                self.file_names[file_id] = file_name
+            else:
+                file_name = self.file_names.get(file_id)
+        return '%s:%d:%d' % (file_name, line, column)
+
+    def apply_deltas(self, time_stamp, memory_usage, time_delta,
+                     memory_delta):
+        if self.version < 2:
+            return time_stamp, memory_usage
+        self.time_base += time_delta
+        self.memory_base += memory_delta
+        return self.time_base * 1e-9, self.memory_base
+
+    def check_memory_samples(self):
+        """Checks the memory of the entries of a top-level instantiation."""
+        entries, self.tree_entries = self.tree_entries, []
+        unsampled = []
+        for count, entry in enumerate(entries, 1):
+            if count % self.args.memory_samples and count != len(entries):
+                unsampled.append(entry)
+                continue
+            (time0, memory0), (time1, memory1) = self.last_sample, entry
+            # Up to the rounding of the time-stamps of version 2, and of the
+            # fused multiply-adds.
+            tolerance = 1
+            if self.version >= 2 and time1 > time0:
+                tolerance += abs(memory1 - memory0) * 1e-9 / (time1 - time0)
+            for time_stamp, memory in unsampled:
+                self.memory_checked += 1
+                if not min(memory0, memory1) <= memory <= max(memory0,
+                                                              memory1):
+                    self.error('memory usage %d is not between the samples '
+                               '%d and %d' % (memory, memory0, memory1))
+                    continue
+                ratio = 0.0
+                if time1 > time0:
+                    ratio = (time_stamp - time0) / (time1 - time0)
+                ratio = min(max(ratio, 0.0), 1.0)
+                expected = int(memory0 + ratio * (memory1 - memory0))
+                if abs(memory - expected) > tolerance:
+                    self.error('memory usage %d is not interpolated, '
+                               'expected %d' % (memory, expected))
+            unsampled = []
+            self.last_sample = entry
+
+    def record_memory(self, time_stamp, memory_usage):
+        # Called after the depth is updated, the depth is back to zero at the
+        # end of each top-level instantiation.
+        if not self.args.memory_samples:
+            return
+        self.tree_entries.append((time_stamp, memory_usage))
+        if self.depth == 0:
+            self.check_memory_samples()
+
+    def check_time(self, time_stamp):
+        if not self.args.check_times:
+            return
+        self.checked += 1
+        if time_stamp <= 0.0:
+            self.error('time-stamp %r is not positive' % time_stamp)
+        if self.last_time is not None and time_stamp < self.last_time:
+            self.error('time-stamp %r is before %r' %
+                       (time_stamp, self.last_time))
+        self.last_time = time_stamp
+
+    def load_begin(self, buf):
+        kind, name, location = 0, '', ''
+        time_stamp, memory_usage, time_delta, memory_delta = 0.0, 0, 0, 0
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                kind = value
+            elif field == 2:
+                name = self.load_name(value)
+            elif field == 3:
+                location = self.load_location(value)
+            elif field == 4:
+                time_stamp = as_double(value)
+            elif field == 5:
+                memory_usage = value
+            elif field == 6:
+                self.load_location(value)  # for the file names it gives.
+            elif field == 7:
+                time_delta = as_sint(value)
+            elif field == 8:
+                memory_delta = as_sint(value)
+        time_stamp, memory_usage = self.apply_deltas(
+            time_stamp, memory_usage, time_delta, memory_delta)
+        self.check_time(time_stamp)
+        line = '%sbegin %s %s %s' % ('  ' * self.depth, KINDS[kind], name,
+                                     location)
+        if not self.args.no_times:
+            line += ' @%.9f' % time_stamp
+        print(line)
+        self.depth += 1
+        self.begin_times.append(time_stamp)
+        self.record_memory(time_stamp, memory_usage)
+
+    def load_end(self, buf):
+        time_stamp, memory_usage, time_delta, memory_delta = 0.0, 0, 0, 0
+        pruned = None
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                time_stamp = as_double(value)
+            elif field == 2:
+                memory_usage = value
+            elif field == 3:
+                pruned = as_double(value)
+            elif field == 4:
+                time_delta = as_sint(value)
+            elif field == 5:
+                memory_delta = as_sint(value)
+        time_stamp, memory_usage = self.apply_deltas(
+            time_stamp, memory_usage, time_delta, memory_delta)
+        self.check_time(time_stamp)
+        self.depth = max(self.depth - 1, 0)
+        self.record_memory(time_stamp, memory_usage)
+        begin_time = self.begin_times.pop() if self.begin_times else None
+        if (self.args.check_times and pruned is not None and
+                begin_time is not None and
+                pruned > time_stamp - begin_time + 1e-9):
+            self.error('pruned time %r exceeds the duration %r' %
+                       (pruned, time_stamp - begin_time))
+        line = '%send' % ('  ' * self.depth)
+        if not self.args.no_times:
+            line += ' @%.9f' % time_stamp
+            if pruned is not None:
+                line += ' pruned=%.9f' % pruned
+        print(line)
+
+    def load_summary(self, buf):
+        kind, name, count, inclusive, exclusive, depth = 0, '', 0, 0.0, 0.0, 0
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                kind = value
+            elif field == 2:
+                name = self.load_name(value)
+            elif field == 4:
+                count = value
+            elif field == 5:
+                inclusive = as_double(value)
+            elif field == 6:
+                exclusive = as_double(value)
+            elif field == 7:
+                depth = value
+        if self.args.check_times:
+            self.checked += 1
+            if exclusive < 0.0 or inclusive < exclusive:
+                self.error('summary times %r and %r of %s are inconsistent' %
+                           (inclusive, exclusive, name))
+        line = 'summary %s %s count=%d depth=%d' % (KINDS[kind], name, count,
+                                                    depth)
+        if not self.args.no_times:
+            line += ' inclusive=%.9f exclusive=%.9f' % (inclusive, exclusive)
+        print(line)
+
+    def load_trace_fields(self, buf):
+        # The time and memory deltas start over in each chunk, and frame.
+        self.reset_deltas()
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                version, chunk = 0, 0
+                for hfield, _, hvalue in read_fields(value):
+                    if hfield == 1:
+                        version = hvalue
+                    elif hfield == 3:
+                        chunk = hvalue
+                if chunk == 0:
+                    self.finish_trace()
+                    self.start_trace()
+                    print('trace')
+                self.version = version
+                self.reset_deltas()
+            elif field == 2:
+                for efield, _, evalue in read_fields(value):
+                    if efield == 1:
+                        self.load_begin(evalue)
+                    elif efield == 2:
+                        self.load_end(evalue)
+            elif field == 3:
+                marked, markers = b'', []
+                for nfield, _, nvalue in read_fields(value):
+                    if nfield == 1:
+                        marked = nvalue
+                    elif nfield == 2:
+                        markers.append(nvalue)
+                self.names.append((marked.decode('utf-8'), markers))
+            elif field == 4:
+                self.load_summary(value)
+
+    def load_compressed_trace(self, buf):
+        data, format = b'', 0
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                format = value
+            elif field == 3:
+                data = value
+        if format != 1:
+            raise ValueError('only zlib-compressed traces are supported')
+        self.load_trace_fields(zlib.decompress(data))
+
+    def load_collection(self, buf):
+        for field, _, value in read_fields(buf):
+            if field == 1:
+                self.load_trace_fields(value)
+            elif field == 2:
+                self.load_compressed_trace(value)
+            elif field == 6:
+                self.load_trace_fields(value)
+        self.finish_trace()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--no-times', action='store_true')
+    parser.add_argument('--check-times', action='store_true')
+    parser.add_argument('--dict-ids', action='store_true')
+    parser.add_argument('--memory-samples', type=int, default=0, metavar='N')
+    parser.add_argument('trace')
+    args = parser.parse_args()
+    with open(args.trace, 'rb') as f:
+        buf = f.read()
+    dumper = TraceDumper(args)
+    dumper.load_collection(buf)
+    return 1 if dumper.failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
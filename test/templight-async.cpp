@@ -0,0 +1,36 @@
+// RUN: rm -f %t.*
+
+// The asynchronous output must not change the entries of the trace, and it
+// replaces the default clock, which would count the output thread.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler \
+// RUN:   -Xtemplight -output=%t.sync.trace.pbf
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -async \
+// RUN:   -Xtemplight -output=%t.async.trace.pbf 2> %t.async.log
+// RUN: FileCheck %s --check-prefix=WARN < %t.async.log
+// RUN: %python %S/Inputs/templight-dump.py --no-times %t.sync.trace.pbf \
+// RUN:   > %t.sync.txt
+// RUN: %python %S/Inputs/templight-dump.py --no-times %t.async.trace.pbf \
+// RUN:   > %t.async.txt
+// RUN: diff %t.sync.txt %t.async.txt
+// RUN: FileCheck %s < %t.async.txt
+
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.async.trace.pbf | FileCheck %s --check-prefix=TIMES \
+// RUN:   --implicit-check-not=error:
+
+// WARN: Warning: [Templight-Tracer] The rusage clock counts the output thread
+
+// CHECK: begin TemplateInstantiation List<int, 3> {{.*}}templight-async.cpp
+// CHECK: begin TemplateInstantiation List<int, 2> {{.*}}templight-async.cpp
+// CHECK: begin TemplateInstantiation List<int, 1> {{.*}}templight-async.cpp
+
+// TIMES: checked {{[1-9][0-9]*}} time-stamps
+
+template <typename T, int N> struct List {
+  T head;
+  List<T, N - 1> tail;
+};
+template <typename T> struct List<T, 0> {};
+
+List<int, 3> l;
@@ -0,0 +1,38 @@
+// RUN: rm -f %t.*.trace.pbf
+
+// Whatever the clock, the time-stamps must be positive and increase along
+// the trace.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -clock=rusage \
+// RUN:   -Xtemplight -output=%t.rusage.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.rusage.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -clock=monotonic \
+// RUN:   -Xtemplight -output=%t.monotonic.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.monotonic.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler \
+// RUN:   -Xtemplight -clock=thread-cputime \
+// RUN:   -Xtemplight -output=%t.thread-cputime.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.thread-cputime.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -clock=tsc \
+// RUN:   -Xtemplight -output=%t.tsc.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.tsc.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// CHECK: trace
+// CHECK: begin TemplateInstantiation Fib<6> {{.*}}templight-clock.cpp
+// CHECK: begin TemplateInstantiation Fib<5> {{.*}}templight-clock.cpp
+// CHECK: checked {{[1-9][0-9]*}} time-stamps
+
+template <int N> struct Fib {
+  static const int value = Fib<N - 1>::value + Fib<N - 2>::value;
+};
+template <> struct Fib<1> { static const int value = 1; };
+template <> struct Fib<0> { static const int value = 0; };
+
+static_assert(Fib<6>::value == 8, "");
@@ -0,0 +1,38 @@
+// RUN: rm -f %t.*.trace.pbf
+
+// The memory is measured at every third entry and at the end of each
+// top-level instantiation, the entries in between are interpolated.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -memory \
+// RUN:   -Xtemplight -memory-source=ast -Xtemplight -memory-sample-events=3 \
+// RUN:   -Xtemplight -clock=monotonic -Xtemplight -output=%t.3.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --memory-samples=3 \
+// RUN:   %t.3.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// With a period longer than the trace, only the ends of the top-level
+// instantiations are measured.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -memory \
+// RUN:   -Xtemplight -memory-source=ast \
+// RUN:   -Xtemplight -memory-sample-events=1000 -Xtemplight -clock=monotonic \
+// RUN:   -Xtemplight -output=%t.1000.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --memory-samples=1000 \
+// RUN:   %t.1000.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -memory \
+// RUN:   -Xtemplight -memory-sample-events=4 -Xtemplight -trace-version=2 \
+// RUN:   -Xtemplight -clock=monotonic -Xtemplight -output=%t.v2.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --memory-samples=4 \
+// RUN:   %t.v2.trace.pbf | FileCheck %s --implicit-check-not=error:
+
+// CHECK: trace
+// CHECK: begin TemplateInstantiation Chain<20> {{.*}}memory-samples.cpp
+// CHECK: begin TemplateInstantiation Chain<1> {{.*}}memory-samples.cpp
+// CHECK: checked {{[1-9][0-9]*}} memory usages
+
+template <int N> struct Chain : Chain<N - 1> {
+  int values[N];
+};
+template <> struct Chain<0> {};
+
+Chain<20> c;
@@ -0,0 +1,48 @@
+// RUN: rm -f %t.*.trace.pbf
+
+// Slow<1> spends milliseconds in the evaluation of its static assertion, so it
+// outlasts the minimum duration, but the instantiation of Small<1> does not and
+// its time is moved to the end of Slow<1>.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -clock=monotonic \
+// RUN:   -Xtemplight -min-duration=1000 \
+// RUN:   -Xtemplight -output=%t.pruned.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.pruned.trace.pbf | FileCheck %s --check-prefix=PRUNED \
+// RUN:   --implicit-check-not=error: --implicit-check-not=Small
+
+// The minimum duration is ignored in safe-mode.
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -clock=monotonic \
+// RUN:   -Xtemplight -min-duration=1000 -Xtemplight -safe-mode \
+// RUN:   -Xtemplight -output=%t.safe.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.safe.trace.pbf | FileCheck %s --check-prefix=SAFE \
+// RUN:   --implicit-check-not=error: --implicit-check-not=pruned=
+
+// PRUNED: trace
+// PRUNED: begin TemplateInstantiation Slow<1> {{.*}}min-duration.cpp
+// PRUNED-NEXT: end @{{[0-9.]+}} pruned={{0\.0*[1-9][0-9]*}}
+// PRUNED: checked {{[1-9][0-9]*}} time-stamps
+
+// SAFE: trace
+// SAFE: begin TemplateInstantiation Slow<1> {{.*}}min-duration.cpp
+// SAFE-NEXT: begin TemplateInstantiation Small<1> {{.*}}min-duration.cpp
+// SAFE-NEXT: end @{{[0-9.]+$}}
+// SAFE: end @{{[0-9.]+$}}
+// SAFE: checked {{[1-9][0-9]*}} time-stamps
+
+constexpr long spin(long N) {
+  long Sum = 0;
+  for (long i = 0; i < N; ++i)
+    Sum += i % 7;
+  return Sum;
+}
+
+template <int N> struct Small { char data[N]; };
+template <int N> struct Slow {
+  Small<N> small;
+  static_assert(spin(100000 + N) > 0, "");
+};
+
+Slow<1> s;
@@ -0,0 +1,25 @@
+// RUN: rm -f %t.trace.pbf
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler \
+// RUN:   -Xtemplight -structural-names -Xtemplight -output=%t.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --no-times --dict-ids \
+// RUN:   %t.trace.pbf | FileCheck %s
+
+// The same template and the same argument keep the same dictionary ids in
+// all the names they appear in, whichever way they are spelled.
+
+// CHECK: begin TemplateInstantiation [[S:ns#[0-9]+::S#[^<]+]]<[[ARG:ns#[0-9]+::StructuralArg#[^,]+]], 2#{{[0-9]+}}>#{{[0-9]+}}
+// CHECK: begin TemplateInstantiation [[S]]<int#{{[0-9]+}}, 3#{{[0-9]+}}>#{{[0-9]+}}
+// CHECK: begin TemplateInstantiation ns#{{[0-9]+}}::Wrap#{{[^<]+}}<[[ARG]]>#{{[0-9]+}}
+
+namespace ns {
+struct StructuralArg {};
+template <typename T, int N> struct S { T value[N]; };
+template <typename T> struct Wrap { T value; };
+} // namespace ns
+
+using Alias = ns::StructuralArg;
+
+ns::S<ns::StructuralArg, 2> a;
+ns::S<int, 3> b = {{1, 2, 3}};
+ns::Wrap<Alias> c;
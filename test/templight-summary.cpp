@@ -0,0 +1,33 @@
+// RUN: rm -f %t.*
+
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -summary \
+// RUN:   -Xtemplight -output=%t.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times %t.trace.pbf \
+// RUN:   | FileCheck %s --check-prefixes=CHECK,ALL --implicit-check-not=error:
+
+// The blacklists apply to each instantiation, so Hidden<4> is left out while
+// the other specializations of Hidden are still counted.
+
+// RUN: echo "identifier ^Hidden<4>" > %t.blacklist
+// RUN: %templight_cc1 %s -Xtemplight -profiler -Xtemplight -summary \
+// RUN:   -Xtemplight -blacklist=%t.blacklist \
+// RUN:   -Xtemplight -output=%t.blacklist.trace.pbf
+// RUN: %python %S/Inputs/templight-dump.py --check-times \
+// RUN:   %t.blacklist.trace.pbf | FileCheck %s \
+// RUN:   --check-prefixes=BLACKLIST,ALL --implicit-check-not=error:
+
+// ALL: trace
+// ALL-DAG: summary TemplateInstantiation S count=3 depth=1
+// CHECK-DAG: summary TemplateInstantiation Hidden count=3 depth=2
+// BLACKLIST-DAG: summary TemplateInstantiation Hidden count=2 depth=2
+// ALL: checked {{[1-9][0-9]*}} time-stamps
+
+template <int N> struct Hidden { char data[N]; };
+template <typename T> struct S {
+  T value;
+  Hidden<sizeof(T)> hidden;
+};
+
+S<char> a;
+S<int> b;
+S<double> c;
@@ -0,0 +1,192 @@
+//===- TemplightColumnarTraceTest.cpp --------------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightColumnarReader.h"
+#include "TemplightColumnarWriter.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+typedef std::vector<std::uint64_t> Row;
+
+std::uint64_t getNS(double TimeStamp) {
+  return std::uint64_t(std::llround(TimeStamp * 1e9));
+}
+
+// Writes random traces of about \p Rows instantiations to \p Writer, with
+// values of \p Bits bits at most in the line and time columns, and appends
+// the rows it expects to read back to \p Expected.
+void writeRandomTrace(TemplightColumnarWriter &Writer, std::size_t Rows,
+                      unsigned Bits, std::mt19937_64 &Rng,
+                      std::vector<Row> &Expected) {
+  const std::uint64_t Mask =
+      (Bits == 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << Bits) - 1);
+  std::vector<std::size_t> Open;
+  double Time = 0.0;
+  for (std::size_t i = 0; (i < Rows) || !Open.empty(); ++i) {
+    Time += double(Rng() & Mask & 0xFFFFFFFFFFull) * 1e-9;
+    if ((i < Rows) && (Open.empty() || ((Open.size() < 12) && (Rng() & 1)))) {
+      PrintableTemplightEntryBegin Begin{};
+      Begin.SynthesisKind = int(Rng() % 12);
+      Begin.Name = "T<" + std::to_string(Rng() % 500) + ">";
+      Begin.FileName = "f" + std::to_string(Rng() % 50) + ".h";
+      Begin.Line = int(Rng() & Mask & 0x7FFFFFFF);
+      if ((Bits == 64) && (Rng() % 7 == 0))
+        Begin.Line = -Begin.Line; // sign-extended to 64 bits.
+      Begin.TimeStamp = Time;
+      Writer.printEntry(Begin);
+      Open.push_back(Expected.size());
+      // The names and files are compared through their hash (see readTrace).
+      Expected.push_back(Row{std::uint64_t(Begin.SynthesisKind),
+                             std::hash<std::string>()(Begin.Name),
+                             std::hash<std::string>()(Begin.FileName),
+                             std::uint64_t(std::int64_t(Begin.Line)),
+                             Open.size() - 1, getNS(Time), 0});
+    } else {
+      Writer.printEntry(PrintableTemplightEntryEnd{Time, 0, 0.0});
+      Row &R = Expected[Open.back()];
+      R[columnar::DurationColumn] = getNS(Time) - R[columnar::StartColumn];
+      Open.pop_back();
+    }
+  }
+}
+
+// Reads all the rows of a columnar trace, with the name and file columns
+// replaced by the hash of the names, and the trace of each row.
+std::vector<Row> readTrace(llvm::StringRef Buffer,
+                           std::vector<std::size_t> *Traces = nullptr) {
+  std::vector<Row> Rows;
+  TemplightColumnarReader Reader;
+  EXPECT_TRUE(Reader.startOnBuffer(Buffer));
+  std::vector<std::uint64_t> Values;
+  while (Reader.nextBlock()) {
+    std::size_t First = Rows.size();
+    Rows.resize(First + Reader.getRowCount(), Row(columnar::NumColumns));
+    for (unsigned C = 0; C < columnar::NumColumns; ++C) {
+      Reader.loadColumn(columnar::Column(C), Values);
+      std::uint64_t Min = ~std::uint64_t(0), Max = 0;
+      for (std::size_t i = 0; i < Values.size(); ++i) {
+        std::uint64_t V = Values[i];
+        Min = std::min(Min, V);
+        Max = std::max(Max, V);
+        if (C == columnar::NameColumn)
+          V = std::hash<std::string>()(Reader.NameMap.at(V));
+        else if (C == columnar::FileColumn)
+          V = std::hash<std::string>()(Reader.FileNameMap.at(V));
+        Rows[First + i][C] = V;
+      }
+      EXPECT_EQ(Min, Reader.getStats(columnar::Column(C)).Min);
+      EXPECT_EQ(Max, Reader.getStats(columnar::Column(C)).Max);
+    }
+    if (Traces)
+      Traces->insert(Traces->end(), Reader.getRowCount(),
+                     Reader.getTraceIndex());
+  }
+  return Rows;
+}
+
+TEST(TemplightColumnarTraceTest, RoundTripAllBlockSizes) {
+  std::mt19937_64 Rng(1);
+  for (std::size_t BlockRows : {1, 2, 3, 7, 64, 1000, 4096, 65536}) {
+    std::vector<Row> Expected;
+    std::string Out;
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightColumnarWriter Writer(OS, BlockRows);
+      Writer.initialize("a.cpp");
+      writeRandomTrace(Writer, 150000, 40, Rng, Expected);
+      Writer.finalize();
+    }
+    EXPECT_EQ(Expected, readTrace(Out)) << "block of " << BlockRows;
+  }
+}
+
+TEST(TemplightColumnarTraceTest, RoundTripAllBitWidths) {
+  // The values straddle the words of a column in every possible way.
+  std::mt19937_64 Rng(2);
+  for (unsigned Bits = 1; Bits <= 64; ++Bits) {
+    std::vector<Row> Expected;
+    std::string Out;
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightColumnarWriter Writer(OS, 333);
+      Writer.initialize("a.cpp");
+      writeRandomTrace(Writer, 1000, Bits, Rng, Expected);
+      Writer.finalize();
+    }
+    EXPECT_EQ(Expected, readTrace(Out)) << Bits << " bits";
+  }
+}
+
+TEST(TemplightColumnarTraceTest, SeveralTraces) {
+  std::mt19937_64 Rng(3);
+  std::vector<Row> Expected;
+  std::vector<std::size_t> ExpectedTraces;
+  std::string Out;
+  {
+    llvm::raw_string_ostream OS(Out);
+    TemplightColumnarWriter Writer(OS, 100);
+    for (std::size_t T = 0; T < 3; ++T) {
+      Writer.initialize("s" + std::to_string(T) + ".cpp");
+      writeRandomTrace(Writer, 500, 32, Rng, Expected);
+      Writer.finalize();
+      ExpectedTraces.resize(Expected.size(), T);
+    }
+  }
+  // The magic string is only at the start of the file.
+  EXPECT_EQ(llvm::StringRef(Out).find(columnar::Magic, 1),
+            llvm::StringRef::npos);
+
+  std::vector<std::size_t> Traces;
+  EXPECT_EQ(Expected, readTrace(Out, &Traces));
+  EXPECT_EQ(ExpectedTraces, Traces);
+
+  TemplightColumnarReader Reader;
+  ASSERT_TRUE(Reader.startOnBuffer(Out));
+  while (Reader.nextBlock())
+    EXPECT_EQ("s" + std::to_string(Reader.getTraceIndex()) + ".cpp",
+              Reader.SourceName);
+}
+
+TEST(TemplightColumnarTraceTest, ConcatenatedFiles) {
+  // Each file numbers its names from zero.
+  std::mt19937_64 Rng(4);
+  std::vector<Row> Expected;
+  std::vector<std::size_t> ExpectedTraces;
+  std::string Files;
+  for (std::size_t T = 0; T < 2; ++T) {
+    std::string Out;
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightColumnarWriter Writer(OS, 100);
+      Writer.initialize("s" + std::to_string(T) + ".cpp");
+      writeRandomTrace(Writer, 500, 32, Rng, Expected);
+      Writer.finalize();
+    }
+    Files += Out;
+    ExpectedTraces.resize(Expected.size(), T);
+  }
+
+  std::vector<std::size_t> Traces;
+  EXPECT_EQ(Expected, readTrace(Files, &Traces));
+  EXPECT_EQ(ExpectedTraces, Traces);
+}
+
+} // namespace
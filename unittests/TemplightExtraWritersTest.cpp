@@ -0,0 +1,578 @@
+//===- TemplightExtraWritersTest.cpp ---------------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightExtraWriters.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/YAMLTraits.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+const char *const KindNames[] = {"TemplateInstantiation",
+                                 "DefaultTemplateArgumentInstantiation",
+                                 "DefaultFunctionArgumentInstantiation",
+                                 "ExplicitTemplateArgumentSubstitution",
+                                 "DeducedTemplateArgumentSubstitution",
+                                 "PriorTemplateArgumentSubstitution",
+                                 "DefaultTemplateArgumentChecking",
+                                 "ExceptionSpecInstantiation",
+                                 "DeclaringSpecialMember",
+                                 "DefiningSynthesizedFunction",
+                                 "Memoization"};
+
+} // namespace
+
+namespace llvm {
+namespace yaml {
+
+// The traits through which TemplightYamlWriter used to write the entries.
+template <> struct MappingTraits<clang::PrintableTemplightEntryBegin> {
+  static void mapping(IO &io, clang::PrintableTemplightEntryBegin &Entry) {
+    bool b = true;
+    io.mapRequired("IsBegin", b);
+    std::string kind = KindNames[Entry.SynthesisKind];
+    io.mapRequired("Kind", kind);
+    io.mapOptional("Name", Entry.Name);
+    std::string loc = Entry.FileName + "|" + std::to_string(Entry.Line) + "|" +
+                      std::to_string(Entry.Column);
+    io.mapOptional("Location", loc);
+    io.mapRequired("TimeStamp", Entry.TimeStamp);
+    io.mapOptional("MemoryUsage", Entry.MemoryUsage);
+    std::string ori = Entry.TempOri_FileName + "|" +
+                      std::to_string(Entry.TempOri_Line) + "|" +
+                      std::to_string(Entry.TempOri_Column);
+    io.mapOptional("TemplateOrigin", ori);
+  }
+};
+
+template <> struct MappingTraits<clang::PrintableTemplightEntryEnd> {
+  static void mapping(IO &io, clang::PrintableTemplightEntryEnd &Entry) {
+    bool b = false;
+    io.mapRequired("IsBegin", b);
+    io.mapRequired("TimeStamp", Entry.TimeStamp);
+    io.mapOptional("MemoryUsage", Entry.MemoryUsage);
+    io.mapOptional("PrunedChildrenTime", Entry.PrunedChildrenTime, 0.0);
+  }
+};
+
+} // namespace yaml
+} // namespace llvm
+
+namespace {
+
+// The YAML writer as it was, on top of llvm::yaml::Output, which the direct
+// emitter of TemplightYamlWriter must match byte for byte.
+class ReferenceYamlWriter : public TemplightWriter {
+public:
+  ReferenceYamlWriter(llvm::raw_ostream &aOS)
+      : TemplightWriter(aOS), Output(new llvm::yaml::Output(OutputOS)) {
+    Output->beginDocuments();
+  }
+  ~ReferenceYamlWriter() { Output->endDocuments(); }
+
+  void initialize(const std::string &aSourceName = "") override {
+    Output->beginSequence();
+  }
+  void finalize() override { Output->endSequence(); }
+
+  void printEntry(const PrintableTemplightEntryBegin &aEntry) override {
+    printElement(const_cast<PrintableTemplightEntryBegin &>(aEntry));
+  }
+  void printEntry(const PrintableTemplightEntryEnd &aEntry) override {
+    printElement(const_cast<PrintableTemplightEntryEnd &>(aEntry));
+  }
+
+private:
+  template <typename T> void printElement(T &aEntry) {
+    void *SaveInfo;
+    if (Output->preflightElement(1, SaveInfo)) {
+      llvm::yaml::EmptyContext Context;
+      llvm::yaml::yamlize(*Output, aEntry, true, Context);
+      Output->postflightElement(SaveInfo);
+    }
+  }
+
+  std::unique_ptr<llvm::yaml::Output> Output;
+};
+
+// The strings that llvm::yaml::Output writes plain, single-quoted or
+// double-quoted, and those in between.
+const char *const YamlStrings[] = {"",
+                                   "foo",
+                                   "ns::t<int>",
+                                   " lead",
+                                   "trail ",
+                                   "true",
+                                   "False",
+                                   "null",
+                                   "~",
+                                   "123",
+                                   "-1.5e3",
+                                   "0x1F",
+                                   "0o17",
+                                   ".inf",
+                                   ".5",
+                                   "1.",
+                                   "e5",
+                                   "-",
+                                   "+",
+                                   "a: b",
+                                   "it's",
+                                   "#x",
+                                   "[x]",
+                                   "@y",
+                                   "%z",
+                                   "a,b",
+                                   "a-b^c_d.e",
+                                   "a/b.h",
+                                   "tab\there",
+                                   "new\nline",
+                                   "del\x7f",
+                                   "ctl\x01",
+                                   "q\"uote",
+                                   "back\\slash",
+                                   "\xc3\xa9t\xc3\xa9",
+                                   "operator< <int>",
+                                   "std::vector<std::pair<int, char *>>::at"};
+
+// Writes one trace per character of \p Pattern, with all the edge cases of
+// the strings and of the time-stamps for 'F', and without entries for 'E'.
+void writeYamlTraces(TemplightWriter &Writer, const std::string &Pattern) {
+  const double Times[] = {0.0,
+                          -0.0,
+                          1e-9,
+                          1.234e-6,
+                          0.1,
+                          1.0 / 3.0,
+                          -2.5,
+                          100000.0,
+                          1000000.0,
+                          123456.789,
+                          1e10,
+                          1e16,
+                          1e-300,
+                          std::numeric_limits<double>::denorm_min(),
+                          std::numeric_limits<double>::max(),
+                          std::numeric_limits<double>::infinity()};
+  for (char C : Pattern) {
+    Writer.initialize("a.cpp");
+    for (std::size_t i = 0; (C == 'F') && (i < std::size(YamlStrings)); ++i) {
+      PrintableTemplightEntryBegin Begin{};
+      Begin.SynthesisKind = int(i % std::size(KindNames));
+      Begin.Name = YamlStrings[i];
+      Begin.FileName = YamlStrings[std::size(YamlStrings) - 1 - i];
+      Begin.Line = int(i * 37);
+      Begin.Column = (i % 5 == 0 ? -1 : int(i));
+      Begin.TimeStamp = Times[i % std::size(Times)];
+      Begin.MemoryUsage = std::uint64_t(1234567890123ull * i);
+      if (i % 3 == 0) {
+        Begin.TempOri_FileName = YamlStrings[i];
+        Begin.TempOri_Line = 3;
+        Begin.TempOri_Column = 4;
+      }
+      Writer.printEntry(Begin);
+      Writer.printEntry(PrintableTemplightEntryEnd{
+          Times[(i + 5) % std::size(Times)], i,
+          (i % 2 == 0 ? Times[(i + 3) % std::size(Times)] : 0.0)});
+    }
+    Writer.finalize();
+  }
+}
+
+TEST(TemplightExtraWritersTest, YamlMatchesYamlOutput) {
+  for (std::string Pattern :
+       {"", "F", "E", "FE", "EF", "FF", "EE", "EFE", "FEF"}) {
+    std::string Expected, Out;
+    {
+      llvm::raw_string_ostream OS(Expected);
+      ReferenceYamlWriter Writer(OS);
+      writeYamlTraces(Writer, Pattern);
+    }
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightYamlWriter Writer(OS);
+      writeYamlTraces(Writer, Pattern);
+    }
+    EXPECT_EQ(Expected, Out) << "traces \"" << Pattern << "\"";
+  }
+}
+
+TEST(TemplightExtraWritersTest, YamlDoublesMatchPrintf) {
+  // The time-stamps are written with std::to_chars where the library has it,
+  // which must give the same digits as the "%g" of llvm::yaml::Output.
+  std::mt19937_64 Rng(1);
+  for (int i = 0; i < 20000; ++i) {
+    // Random digits at all the scales where "%g" switches between the fixed
+    // and the exponent forms, and a few steps of rounding.
+    double Value = std::ldexp(double(Rng() >> 11), -52) *
+                   std::pow(10.0, int(Rng() % 40) - 20);
+    if (i % 4 == 0)
+      Value = std::round(Value * 1e6) / 1e6;
+    std::string Expected, Out;
+    {
+      llvm::raw_string_ostream OS(Expected);
+      ReferenceYamlWriter Writer(OS);
+      Writer.initialize();
+      Writer.printEntry(PrintableTemplightEntryEnd{Value, 0, 0.0});
+      Writer.finalize();
+    }
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightYamlWriter Writer(OS);
+      Writer.initialize();
+      Writer.printEntry(PrintableTemplightEntryEnd{Value, 0, 0.0});
+      Writer.finalize();
+    }
+    ASSERT_EQ(Expected, Out);
+  }
+}
+
+// Prints a trace of one entry per character of \p Entries to \p Writer: a
+// letter begins an instantiation of "<letter><int>" (or of the name at its
+// index in \p Names) on the line of its position, and a ')' or a ']' ends the
+// latest one, with a pruned time of half a microsecond for ']'. The entry at
+// position k is at (k + 1) microseconds and uses 100 * (k + 1) bytes. The
+// instantiations of 'B' come from the template at b.h:42:7, and those of 'C'
+// are default template argument instantiations.
+void printTrace(TemplightWriter &Writer, llvm::StringRef Entries,
+                const std::vector<std::string> &Names = {}) {
+  Writer.initialize("a.cpp");
+  for (std::size_t k = 0; k < Entries.size(); ++k) {
+    double Time = double(k + 1) * 1e-6;
+    std::uint64_t Memory = 100 * (k + 1);
+    if ((Entries[k] == ')') || (Entries[k] == ']')) {
+      Writer.printEntry(PrintableTemplightEntryEnd{
+          Time, Memory, (Entries[k] == ']' ? 0.5e-6 : 0.0)});
+      continue;
+    }
+    std::size_t Letter = std::size_t(Entries[k] - 'A');
+    PrintableTemplightEntryBegin Begin{};
+    Begin.SynthesisKind = (Entries[k] == 'C' ? 1 : 0);
+    Begin.Name = (Letter < Names.size() ? Names[Letter]
+                                        : std::string(1, Entries[k]) + "<int>");
+    Begin.FileName = "a.cpp";
+    Begin.Line = int(k + 1);
+    Begin.TimeStamp = Time;
+    Begin.MemoryUsage = Memory;
+    if (Entries[k] == 'B') {
+      Begin.TempOri_FileName = "b.h";
+      Begin.TempOri_Line = 42;
+      Begin.TempOri_Column = 7;
+    }
+    Writer.printEntry(Begin);
+  }
+  Writer.finalize();
+}
+
+// Moves the <Cost/> elements of the streaming XML layout into the attributes
+// of their <Entry> elements, as in the nested XML layout.
+std::string nestXmlCosts(llvm::StringRef Xml) {
+  llvm::SmallVector<llvm::StringRef, 32> Lines;
+  Xml.split(Lines, '\n');
+  std::vector<std::string> Nested;
+  std::vector<std::size_t> OpenEntries;
+  for (llvm::StringRef Line : Lines) {
+    if (Line.starts_with("<Cost ")) {
+      std::string &Heading = Nested[OpenEntries.back()];
+      Heading.pop_back(); // the '>'
+      Heading += Line.drop_front(5).drop_back(2).str() + ">";
+      continue;
+    }
+    if (Line.starts_with("<Entry "))
+      OpenEntries.push_back(Nested.size());
+    else if (Line == "</Entry>")
+      OpenEntries.pop_back();
+    Nested.push_back(Line.str());
+  }
+  return llvm::join(Nested, "\n");
+}
+
+// Keeps the node and the edge lines of a GraphViz or GraphML graph, as
+// "n<id>" and "n<id> -> n<id>".
+std::vector<std::string> getGraphIds(llvm::StringRef Graph) {
+  llvm::SmallVector<llvm::StringRef, 32> Lines;
+  Graph.split(Lines, '\n');
+  std::vector<std::string> Ids;
+  for (llvm::StringRef Line : Lines) {
+    if (Line.consume_front("<node id=\"")) {
+      Ids.push_back(Line.take_until([](char c) { return c == '"'; }).str());
+    } else if (Line.consume_front("<edge id=\"")) {
+      Line = Line.drop_until([](char c) { return c == ' '; });
+      llvm::StringRef Source = Line.split("source=\"").second.split('"').first;
+      llvm::StringRef Target = Line.split("target=\"").second.split('"').first;
+      Ids.push_back((Source + " -> " + Target).str());
+    } else if (Line.starts_with("n")) {
+      llvm::StringRef Node = Line.split(' ').first;
+      if (Line.contains(" [label = "))
+        Ids.push_back(Node.str());
+      else
+        Ids.push_back((Node + " -> " + Line.split("-> ").second.drop_back())
+                          .str());
+    }
+  }
+  return Ids;
+}
+
+TEST(TemplightExtraWritersTest, StreamingXmlEntries) {
+  std::string Out;
+  {
+    llvm::raw_string_ostream OS(Out);
+    TemplightStreamingXMLWriter Writer(OS);
+    printTrace(Writer, "AB)]");
+  }
+  EXPECT_EQ("<?xml version=\"1.0\" standalone=\"yes\"?>\n"
+            "<Trace>\n"
+            "<Entry Kind=\"TemplateInstantiation\" Name=\"A&lt;int&gt;\" "
+            "Location=\"a.cpp|1|0\">\n"
+            "<Entry Kind=\"TemplateInstantiation\" Name=\"B&lt;int&gt;\" "
+            "Location=\"a.cpp|2|0\" TemplateOrigin=\"b.h|42|7\">\n"
+            "<Cost Time=\"0.000001000\" Memory=\"100\"/>\n"
+            "</Entry>\n"
+            "<Cost Time=\"0.000003000\" Memory=\"300\"/>\n"
+            "</Entry>\n"
+            "</Trace>\n",
+            Out);
+}
+
+TEST(TemplightExtraWritersTest, StreamingXmlMatchesNestedXml) {
+  // The entries are in the same order in both layouts, including those that
+  // never end (closed by finalize()) and the ends without a begin.
+  std::mt19937_64 Rng(1);
+  std::string RandomEntries;
+  for (int i = 0; i < 300; ++i)
+    RandomEntries += (Rng() % 2 == 0 ? "ABCD"[Rng() % 4] : ')');
+  for (const std::string &Entries : std::vector<std::string>{
+           "", "A)", "ABC))D))E)", "AB", "))A)", "AB)C", RandomEntries}) {
+    std::string Streaming, Nested;
+    {
+      llvm::raw_string_ostream OS(Streaming);
+      TemplightStreamingXMLWriter Writer(OS);
+      printTrace(Writer, Entries);
+      printTrace(Writer, "A)");
+    }
+    {
+      llvm::raw_string_ostream OS(Nested);
+      TemplightNestedXMLWriter Writer(OS);
+      printTrace(Writer, Entries);
+      printTrace(Writer, "A)");
+    }
+    EXPECT_EQ(Nested, nestXmlCosts(Streaming))
+        << "entries \"" << Entries << "\"";
+  }
+}
+
+TEST(TemplightExtraWritersTest, GraphNodeIds) {
+  // The nodes are numbered in pre-order across the traces, and printed with
+  // the edge from their parent once they end.
+  const std::vector<std::string> Expected = {
+      "n2", "n1 -> n2", "n1", "n0 -> n1", "n3", "n0 -> n3",
+      "n0", "n4",       "n6", "n5 -> n6", "n5"};
+  std::string GraphViz, GraphML;
+  {
+    llvm::raw_string_ostream OS(GraphViz);
+    TemplightGraphVizWriter Writer(OS);
+    printTrace(Writer, "ABC))D))E)");
+    printTrace(Writer, "AB");
+  }
+  {
+    llvm::raw_string_ostream OS(GraphML);
+    TemplightGraphMLWriter Writer(OS);
+    printTrace(Writer, "ABC))D))E)");
+    printTrace(Writer, "AB");
+  }
+  EXPECT_EQ(Expected, getGraphIds(GraphViz));
+  EXPECT_EQ(Expected, getGraphIds(GraphML));
+  EXPECT_NE(std::string::npos,
+            GraphML.find("<edge id=\"e3\" source=\"n5\" target=\"n6\"/>"));
+}
+
+// Lists the fields of a Chrome trace event, as "key=value" with the values
+// in JSON, and the fields of its arguments as "args.key=value".
+std::string describeTraceEvent(const llvm::json::Object &Event) {
+  std::string Description;
+  llvm::raw_string_ostream OS(Description);
+  for (llvm::StringRef Key : {"name", "cat", "ph", "pid", "tid", "ts", "dur"})
+    if (const llvm::json::Value *Field = Event.get(Key))
+      OS << " " << Key << "=" << *Field;
+  if (const llvm::json::Object *Args = Event.getObject("args")) {
+    for (llvm::StringRef Key : {"name", "kind", "location", "origin", "memory",
+                                "pruned_children_dur"})
+      if (const llvm::json::Value *Field = Args->get(Key))
+        OS << " args." << Key << "=" << *Field;
+  }
+  OS.flush();
+  return Description;
+}
+
+TEST(TemplightExtraWritersTest, ChromeTraceEvents) {
+  std::string Out;
+  {
+    llvm::raw_string_ostream OS(Out);
+    TemplightChromeTraceWriter Writer(OS);
+    printTrace(Writer, "AB)C)]");
+    printTrace(Writer, "))A");
+  }
+  // The times are in microseconds, to the nanosecond.
+  EXPECT_NE(std::string::npos, Out.find("\"ts\":2.000,\"dur\":1.000,"));
+
+  llvm::Expected<llvm::json::Value> Trace = llvm::json::parse(Out);
+  ASSERT_TRUE(bool(Trace)) << llvm::toString(Trace.takeError());
+  const llvm::json::Object *Root = Trace->getAsObject();
+  ASSERT_NE(nullptr, Root);
+  EXPECT_EQ(llvm::StringRef("ms"), Root->getString("displayTimeUnit"));
+  const llvm::json::Array *Events = Root->getArray("traceEvents");
+  ASSERT_NE(nullptr, Events);
+
+  // An event per trace names its process, and an "X" event per instantiation
+  // follows its end.
+  std::vector<std::string> Descriptions;
+  for (const llvm::json::Value &Event : *Events) {
+    ASSERT_NE(nullptr, Event.getAsObject());
+    Descriptions.push_back(describeTraceEvent(*Event.getAsObject()));
+  }
+  const std::vector<std::string> Expected = {
+      " name=\"process_name\" ph=\"M\" pid=1 tid=0 args.name=\"a.cpp\"",
+      " name=\"B<int>\" cat=\"TemplateInstantiation\" ph=\"X\" pid=1 tid=0"
+      " ts=2 dur=1 args.kind=\"TemplateInstantiation\""
+      " args.location=\"a.cpp|2|0\" args.origin=\"b.h|42|7\" args.memory=100",
+      " name=\"C<int>\" cat=\"DefaultTemplateArgumentInstantiation\" ph=\"X\""
+      " pid=1 tid=0 ts=4 dur=1"
+      " args.kind=\"DefaultTemplateArgumentInstantiation\""
+      " args.location=\"a.cpp|4|0\" args.memory=100",
+      " name=\"A<int>\" cat=\"TemplateInstantiation\" ph=\"X\" pid=1 tid=0"
+      " ts=1 dur=5 args.kind=\"TemplateInstantiation\""
+      " args.location=\"a.cpp|1|0\" args.memory=500"
+      " args.pruned_children_dur=0.5",
+      " name=\"process_name\" ph=\"M\" pid=2 tid=0 args.name=\"a.cpp\"",
+      " name=\"A<int>\" cat=\"TemplateInstantiation\" ph=\"X\" pid=2 tid=0"
+      " ts=3 dur=0 args.kind=\"TemplateInstantiation\""
+      " args.location=\"a.cpp|3|0\" args.memory=0"};
+  EXPECT_EQ(Expected, Descriptions);
+}
+
+TEST(TemplightExtraWritersTest, CallgrindCosts) {
+  // The costs of the functions exclude those of their calls and the pruned
+  // time, the calls are summed up per caller and callee, and each name is
+  // only written the first time.
+  std::string Out;
+  {
+    llvm::raw_string_ostream OS(Out);
+    TemplightCallgrindWriter Writer(OS);
+    printTrace(Writer, "AB)B)C)]");
+    printTrace(Writer, "B)");
+  }
+  EXPECT_EQ("# callgrind format\n"
+            "version: 1\n"
+            "creator: templight\n"
+            "positions: line\n"
+            "event: Time : Instantiation Time (ns)\n"
+            "event: Memory : Memory Usage (bytes)\n"
+            "events: Time Memory\n"
+            "\n"
+            "ob=(1) TemplateInstantiation\n"
+            "fl=(1) a.cpp\n"
+            "fn=(1) A<int>\n"
+            "1 3500 400\n"
+            "cob=(1)\n"
+            "cfl=(2) b.h\n"
+            "cfn=(2) B<int>\n"
+            "calls=2 42\n"
+            "1 2000 200\n"
+            "cob=(2) DefaultTemplateArgumentInstantiation\n"
+            "cfl=(1)\n"
+            "cfn=(3) C<int>\n"
+            "calls=1 6\n"
+            "1 1000 100\n"
+            "\n"
+            "ob=(1)\n"
+            "fl=(2)\n"
+            "fn=(2)\n"
+            "42 3000 300\n"
+            "\n"
+            "ob=(2)\n"
+            "fl=(1)\n"
+            "fn=(3)\n"
+            "6 1000 100\n"
+            "\n",
+            Out);
+}
+
+TEST(TemplightExtraWritersTest, FoldedStacks) {
+  // The stacks are written depth-first, with the exclusive times in
+  // nanoseconds, and the time beyond the maximum depth goes to the deepest
+  // frame written.
+  const std::pair<unsigned, const char *> Expected[] = {
+      {0, "A<int> 3500\n"
+          "A<int>;B<int> 4000\n"
+          "A<int>;B<int>;C<int> 1000\n"
+          "A<int>;B<int>;D<int> 1000\n"},
+      {2, "A<int> 3500\n"
+          "A<int>;B<int> 6000\n"},
+      {1, "A<int> 9500\n"}};
+  for (const auto &MaxDepthAndStacks : Expected) {
+    std::string Out;
+    {
+      llvm::raw_string_ostream OS(Out);
+      TemplightFoldedStackWriter Writer(OS);
+      Writer.setMaxStackDepth(MaxDepthAndStacks.first);
+      printTrace(Writer, "ABC)D)))");
+      printTrace(Writer, "AB)]");
+    }
+    EXPECT_EQ(MaxDepthAndStacks.second, Out)
+        << "maximum depth " << MaxDepthAndStacks.first;
+  }
+}
+
+TEST(TemplightExtraWritersTest, FoldedStacksOfPrimaryTemplates) {
+  // The template arguments are removed, but not the angle brackets of the
+  // operators, and the specializations of a template share their frames.
+  const std::vector<std::string> Names = {
+      "std::vector<int>::push_back",
+      "std::vector<char>::push_back",
+      "operator<< <int>",
+      "std::less<void>::operator()<int, int>",
+      "my_operator<int>",
+      "xoperator<int>",
+      "operator< <std::pair<int, int>>",
+      "std::vector<long>::push_back",
+      "a;b<int>"};
+  std::string Out;
+  {
+    llvm::raw_string_ostream OS(Out);
+    TemplightFoldedStackWriter Writer(OS);
+    Writer.setPrimaryTemplateNames(true);
+    printTrace(Writer, "AB)C)D)E)F)G)I))", Names);
+    printTrace(Writer, "H)", Names);
+  }
+  EXPECT_EQ("std::vector::push_back 9000\n"
+            "std::vector::push_back;std::vector::push_back 1000\n"
+            "std::vector::push_back;operator<< 1000\n"
+            "std::vector::push_back;std::less::operator() 1000\n"
+            "std::vector::push_back;my_operator 1000\n"
+            "std::vector::push_back;xoperator 1000\n"
+            "std::vector::push_back;operator< 1000\n"
+            "std::vector::push_back;a,b 1000\n",
+            Out);
+}
+
+} // namespace
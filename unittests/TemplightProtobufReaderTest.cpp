@@ -0,0 +1,578 @@
+//===- TemplightProtobufReaderTest.cpp -------------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightMappedTraceReader.h"
+#include "TemplightProtobufReader.h"
+#include "TemplightProtobufWriter.h"
+#include "ThinProtobuf.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace clang;
+
+namespace {
+
+// Writes the trace A { B { C { } } D { } } E { }, one entry per microsecond.
+std::string writeTrace(bool Frames, std::size_t ChunkSize) {
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  TemplightProtobufWriter Writer(OS);
+  Writer.setTraceVersion(2);
+  Writer.setTraceFrames(Frames);
+  Writer.setChunkSize(ChunkSize);
+  Writer.initialize("a.cpp");
+  double Time = 1.0;
+  for (char C : std::string("ABC))D))E)")) {
+    Time += 1e-6;
+    if (C == ')') {
+      Writer.printEntry(PrintableTemplightEntryEnd{Time, 0, 0.0});
+      continue;
+    }
+    PrintableTemplightEntryBegin Begin{};
+    Begin.Name = std::string(1, C) + "<int>";
+    Begin.FileName = "a.cpp";
+    Begin.TimeStamp = Time;
+    Writer.printEntry(Begin);
+  }
+  Writer.finalize();
+  OS.flush();
+  return Out;
+}
+
+// Reads the trace without the sub-trees of B, as "name@microseconds" for the
+// begin entries and ")@microseconds" for the end entries.
+std::vector<std::string> readFilteredTrace(llvm::StringRef Trace) {
+  std::vector<std::string> Entries;
+  TemplightProtobufReader Reader;
+  Reader.setEntryFilter(
+      [&](const TemplightProtobufReader::EntryFilterInfo &Info) {
+        return !Reader.getName(Info.NameId).starts_with("B");
+      });
+  for (TemplightProtobufReader::LastChunkType Chunk =
+           Reader.startOnBuffer(Trace);
+       Chunk != TemplightProtobufReader::EndOfFile; Chunk = Reader.next()) {
+    if (Chunk == TemplightProtobufReader::BeginEntry)
+      Entries.push_back(
+          Reader.LastBeginEntry.Name.substr(0, 1) + "@" +
+          std::to_string(
+              int((Reader.LastBeginEntry.TimeStamp - 1.0) * 1e6 + 0.5)));
+    else if (Chunk == TemplightProtobufReader::EndEntry)
+      Entries.push_back(
+          ")@" + std::to_string(
+                     int((Reader.LastEndEntry.TimeStamp - 1.0) * 1e6 + 0.5)));
+  }
+  return Entries;
+}
+
+struct TraceOptions {
+  unsigned Version = 1;
+  std::size_t ChunkSize = 0;
+  bool Compress = false;
+  bool Index = false;
+  bool Frames = false;
+  int CompressLevel = 0;
+};
+
+// Writes a random trace of \p Trees top-level instantiations, with nested
+// instantiations, names from a small set, and time-stamps in whole
+// nanoseconds (such that all the versions of the format hold them exactly).
+std::string writeRandomTrace(const TraceOptions &Options, unsigned Seed,
+                             std::size_t Trees,
+                             const std::string &SourceName = "a.cpp") {
+  std::string Out;
+  llvm::raw_string_ostream OS(Out);
+  TemplightProtobufWriter Writer(OS);
+  Writer.setTraceVersion(Options.Version);
+  Writer.setChunkSize(Options.ChunkSize);
+  Writer.setTraceCompression(Options.Compress, Options.CompressLevel);
+  Writer.setTraceIndex(Options.Index);
+  Writer.setTraceFrames(Options.Frames);
+  Writer.initialize(SourceName);
+  std::mt19937 Rng(Seed);
+  std::int64_t TimeNS = 1000000000;
+  std::uint64_t Memory = 1 << 20;
+  std::size_t Depth = 0;
+  for (std::size_t Tree = 0; (Tree < Trees) || (Depth > 0);) {
+    TimeNS += Rng() % 5000;
+    Memory += Rng() % 4096 - 1024;
+    if ((Depth == 0) || ((Depth < 6) && (Rng() % 3 != 0))) {
+      PrintableTemplightEntryBegin Begin{};
+      Begin.SynthesisKind = int(Rng() % 12);
+      Begin.Name = "ns::T" + std::to_string(Rng() % 20) + "<int, " +
+                   std::to_string(Rng() % 5) + ">";
+      Begin.FileName = "f" + std::to_string(Rng() % 4) + ".h";
+      Begin.Line = int(Rng() % 1000);
+      Begin.Column = int(Rng() % 80);
+      Begin.TimeStamp = TimeNS * 1e-9;
+      Begin.MemoryUsage = Memory;
+      Writer.printEntry(Begin);
+      ++Depth;
+    } else {
+      Writer.printEntry(
+          PrintableTemplightEntryEnd{TimeNS * 1e-9, Memory, 0.0});
+      if (--Depth == 0)
+        ++Tree;
+    }
+  }
+  Writer.finalize();
+  OS.flush();
+  return Out;
+}
+
+std::string printBeginEntry(const PrintableTemplightEntryBegin &Entry) {
+  return "begin " + std::to_string(Entry.SynthesisKind) + " " + Entry.Name +
+         " " + Entry.FileName + ":" + std::to_string(Entry.Line) + ":" +
+         std::to_string(Entry.Column) + " @" +
+         std::to_string(std::llround(Entry.TimeStamp * 1e9)) + " " +
+         std::to_string(Entry.MemoryUsage);
+}
+
+std::string printEntry(const TemplightProtobufReader &Reader) {
+  if (Reader.LastChunk == TemplightProtobufReader::BeginEntry)
+    return printBeginEntry(Reader.LastBeginEntry);
+  if (Reader.LastChunk == TemplightProtobufReader::EndEntry)
+    return "end @" +
+           std::to_string(std::llround(Reader.LastEndEntry.TimeStamp * 1e9)) +
+           " " + std::to_string(Reader.LastEndEntry.MemoryUsage);
+  if ((Reader.LastChunk == TemplightProtobufReader::Header) &&
+      (Reader.Chunk == 0))
+    return "trace " + Reader.SourceName;
+  return "";
+}
+
+// Reads the rest of the traces from a started reader, one line per entry
+// (and per trace), which do not depend on the format options.
+void readEntries(TemplightProtobufReader &Reader,
+                 std::vector<std::string> &Entries) {
+  for (; Reader.LastChunk != TemplightProtobufReader::EndOfFile;
+       Reader.next()) {
+    std::string Entry = printEntry(Reader);
+    if (!Entry.empty())
+      Entries.push_back(Entry);
+  }
+}
+
+std::vector<std::string> readEntries(llvm::StringRef Trace) {
+  std::vector<std::string> Entries;
+  TemplightProtobufReader Reader;
+  Reader.startOnBuffer(Trace);
+  readEntries(Reader, Entries);
+  return Entries;
+}
+
+const std::vector<std::string> ExpectedEntries = {"A@1", "D@6", ")@7",
+                                                  ")@8",  "E@9", ")@10"};
+
+TEST(TemplightProtobufReaderTest, FilterSubtree) {
+  EXPECT_EQ(ExpectedEntries, readFilteredTrace(writeTrace(false, 0)));
+}
+
+TEST(TemplightProtobufReaderTest, FilterSubtreeInChunks) {
+  // A tiny chunk size puts every top-level tree in a chunk of its own.
+  EXPECT_EQ(ExpectedEntries, readFilteredTrace(writeTrace(false, 1)));
+}
+
+TEST(TemplightProtobufReaderTest, FilterSubtreeAcrossFrames) {
+  // Every entry is in a frame of its own.
+  EXPECT_EQ(ExpectedEntries, readFilteredTrace(writeTrace(true, 0)));
+}
+
+TEST(TemplightProtobufReaderTest, MergedTraces) {
+  // The driver merges the traces of its sources with a newline after each.
+  const TraceOptions Options[] = {
+      {1, 0, false, false, false}, {1, 300, false, false, false},
+      {1, 300, true, false, false}, {2, 300, false, true, false},
+      {2, 0, true, false, false},   {1, 0, false, false, true}};
+  std::string Merged;
+  std::vector<std::vector<std::string>> Expected;
+  std::vector<std::string> AllExpected;
+  for (std::size_t i = 0; i < std::size(Options); ++i) {
+    std::string Trace = writeRandomTrace(Options[i], unsigned(i), 20,
+                                         "s" + std::to_string(i) + ".cpp");
+    Expected.push_back(readEntries(Trace));
+    ASSERT_EQ("trace s" + std::to_string(i) + ".cpp", Expected.back().front());
+    AllExpected.insert(AllExpected.end(), Expected.back().begin(),
+                       Expected.back().end());
+    Merged += Trace;
+    Merged += '\n';
+  }
+
+  EXPECT_EQ(AllExpected, readEntries(Merged));
+
+  std::vector<llvm::StringRef> Traces;
+  TemplightProtobufReader::splitTraces(Merged, Traces);
+  ASSERT_EQ(Expected.size(), Traces.size());
+  for (std::size_t i = 0; i < Traces.size(); ++i)
+    EXPECT_EQ(Expected[i], readEntries(Traces[i])) << "trace " << i;
+
+  std::vector<std::vector<std::string>> Results(Expected.size() + 1);
+  TemplightProtobufReader::readTracesInParallel(
+      Merged,
+      [&](std::size_t i, TemplightProtobufReader &Reader) {
+        readEntries(Reader, Results[std::min(i, Expected.size())]);
+      },
+      4);
+  Results.pop_back(); // where the traces beyond the expected ones go.
+  EXPECT_EQ(Expected, Results);
+}
+
+// Returns the time delta of the first entry of each chunk of an uncompressed
+// trace of version 2.
+std::vector<std::int64_t> getFirstTimeDeltas(llvm::StringRef Trace) {
+  std::vector<std::int64_t> Deltas;
+  while (!Trace.empty()) {
+    std::uint64_t Key = llvm::protobuf::loadVarInt(Trace);
+    if (Key != llvm::protobuf::getStringWire<1>::value) {
+      llvm::protobuf::skipData(Trace, Key & 0x7);
+      continue;
+    }
+    llvm::StringRef Chunk = llvm::protobuf::loadStringRef(Trace);
+    while (!Chunk.empty()) {
+      Key = llvm::protobuf::loadVarInt(Chunk);
+      if (Key != llvm::protobuf::getStringWire<2>::value) {
+        llvm::protobuf::skipData(Chunk, Key & 0x7);
+        continue;
+      }
+      // The chunks only start with the begin entry of a top-level tree.
+      llvm::StringRef Entry = llvm::protobuf::loadStringRef(Chunk);
+      if (llvm::protobuf::loadVarInt(Entry) !=
+          llvm::protobuf::getStringWire<1>::value)
+        break;
+      llvm::StringRef Begin = llvm::protobuf::loadStringRef(Entry);
+      while (!Begin.empty()) {
+        Key = llvm::protobuf::loadVarInt(Begin);
+        if (Key == llvm::protobuf::getSIntWire<7>::value) {
+          Deltas.push_back(llvm::protobuf::loadSInt(Begin));
+          break;
+        }
+        llvm::protobuf::skipData(Begin, Key & 0x7);
+      }
+      break;
+    }
+  }
+  return Deltas;
+}
+
+TEST(TemplightProtobufReaderTest, VersionTwoAcrossChunks) {
+  const std::vector<std::string> Expected =
+      readEntries(writeRandomTrace({1, 0, false, false, false}, 9, 60));
+  for (std::size_t ChunkSize : {1, 100, 500, 4096}) {
+    std::string Trace =
+        writeRandomTrace({2, ChunkSize, false, false, false}, 9, 60);
+    EXPECT_EQ(Expected, readEntries(Trace)) << "chunks of " << ChunkSize;
+
+    // The deltas start over in each chunk, from a time-stamp of zero.
+    std::vector<std::int64_t> FirstTimes;
+    TemplightProtobufReader Reader;
+    for (TemplightProtobufReader::LastChunkType Chunk =
+             Reader.startOnBuffer(Trace);
+         Chunk != TemplightProtobufReader::EndOfFile; Chunk = Reader.next())
+      if ((Chunk == TemplightProtobufReader::BeginEntry) &&
+          (Reader.Chunk == FirstTimes.size()))
+        FirstTimes.push_back(
+            std::llround(Reader.LastBeginEntry.TimeStamp * 1e9));
+    EXPECT_LT(1u, FirstTimes.size()) << "chunks of " << ChunkSize;
+    EXPECT_EQ(FirstTimes, getFirstTimeDeltas(Trace))
+        << "chunks of " << ChunkSize;
+  }
+}
+
+TEST(TemplightProtobufReaderTest, CompressedChunks) {
+  if (!llvm::compression::zstd::isAvailable() &&
+      !llvm::compression::zlib::isAvailable())
+    GTEST_SKIP() << "LLVM was built without zstd or zlib";
+
+  // Whatever the version, chunks and level, the compressed traces must read
+  // back exactly as the uncompressed trace of version 1.
+  std::string Uncompressed =
+      writeRandomTrace({1, 0, false, false, false}, 10, 60);
+  const std::vector<std::string> Expected = readEntries(Uncompressed);
+  const TraceOptions Options[] = {
+      {1, 0, true, false, false, 0},   {1, 1, true, false, false, 0},
+      {1, 500, true, false, false, 1}, {2, 0, true, false, false, 0},
+      {2, 1, true, false, false, 9},   {2, 500, true, false, false, 0},
+      {2, 4096, true, false, false, 3}};
+  for (std::size_t i = 0; i < std::size(Options); ++i) {
+    std::string Trace = writeRandomTrace(Options[i], 10, 60);
+    EXPECT_EQ(Expected, readEntries(Trace)) << "options " << i;
+    if (Options[i].ChunkSize != 1)
+      EXPECT_LT(Trace.size(), Uncompressed.size()) << "options " << i;
+  }
+}
+
+TEST(TemplightProtobufReaderTest, MappedTraceReader) {
+  // A trace of many chunks over several pages reads back the same through
+  // the mapping, with the pages released as soon as a page was read, or
+  // every few pages.
+  std::string Trace = writeRandomTrace({2, 500, false, false, false}, 11, 400);
+  const std::size_t PageSize = llvm::sys::fs::mapped_file_region::alignment();
+  ASSERT_LT(8 * PageSize, Trace.size());
+  const std::vector<std::string> Expected = readEntries(Trace);
+
+  llvm::SmallString<128> Path;
+  int FD;
+  ASSERT_FALSE(llvm::sys::fs::createTemporaryFile("templight-mapped", "pbf",
+                                                  FD, Path));
+  llvm::FileRemover Remover(Path);
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Trace;
+  }
+
+  for (std::size_t ReleaseSize : {std::size_t(1), 3 * PageSize}) {
+    std::vector<std::string> Entries;
+    unsigned LastChunk = 0;
+    TemplightMappedTraceReader Mapped(ReleaseSize);
+    for (Mapped.open(std::string(Path));
+         Mapped.Reader.LastChunk != TemplightProtobufReader::EndOfFile;
+         Mapped.next()) {
+      LastChunk = Mapped.Reader.Chunk;
+      std::string Entry = printEntry(Mapped.Reader);
+      if (!Entry.empty())
+        Entries.push_back(Entry);
+    }
+    EXPECT_LT(8u, LastChunk) << "release size " << ReleaseSize;
+    EXPECT_EQ(Expected, Entries) << "release size " << ReleaseSize;
+  }
+}
+
+// Splits the entries of a trace into its top-level trees.
+std::vector<std::vector<std::string>>
+splitTrees(const std::vector<std::string> &Entries) {
+  std::vector<std::vector<std::string>> Trees;
+  int Depth = 0;
+  for (const std::string &Entry : Entries) {
+    if (Entry.compare(0, 6, "trace ") == 0)
+      continue;
+    if (Depth == 0)
+      Trees.emplace_back();
+    Trees.back().push_back(Entry);
+    Depth += (Entry.compare(0, 6, "begin ") == 0 ? 1 : -1);
+  }
+  return Trees;
+}
+
+void checkIndex(const TraceOptions &Options, const std::string &Prefix) {
+  std::string Trace = writeRandomTrace(Options, 7, 40);
+  std::vector<std::vector<std::string>> Trees =
+      splitTrees(readEntries(Trace));
+  ASSERT_EQ(40u, Trees.size());
+
+  // The index is found from the end of the file, whatever comes before.
+  std::string File = Prefix + Trace;
+  TemplightProtobufReader Reader;
+  ASSERT_TRUE(Reader.loadIndex(File));
+  ASSERT_EQ(Trees.size(), Reader.IndexedTrees.size());
+
+  // In reverse order, such that the names of the later chunks are loaded
+  // before the trees of the earlier ones are read.
+  for (std::size_t i = Trees.size(); i-- > 0;) {
+    std::vector<std::string> Entries;
+    Reader.seekToTree(i);
+    readEntries(Reader, Entries);
+    EXPECT_EQ(Trees[i], Entries) << "tree " << i;
+
+    const TemplightProtobufReader::IndexedTree &T = Reader.IndexedTrees[i];
+    std::int64_t Begin = std::stoll(Trees[i].front().substr(
+        Trees[i].front().rfind('@') + 1));
+    std::int64_t End =
+        std::stoll(Trees[i].back().substr(Trees[i].back().rfind('@') + 1));
+    EXPECT_EQ(Begin, std::llround(T.TimeStamp * 1e9));
+    EXPECT_EQ(End - Begin, std::llround(T.Duration * 1e9));
+  }
+
+  std::vector<std::size_t> Slowest;
+  Reader.getSlowestTrees(Trees.size(), Slowest);
+  ASSERT_EQ(Trees.size(), Slowest.size());
+  std::vector<bool> Seen(Trees.size(), false);
+  for (std::size_t i = 0; i < Slowest.size(); ++i) {
+    ASSERT_LT(Slowest[i], Trees.size());
+    EXPECT_FALSE(Seen[Slowest[i]]);
+    Seen[Slowest[i]] = true;
+    if (i > 0)
+      EXPECT_GE(Reader.IndexedTrees[Slowest[i - 1]].Duration,
+                Reader.IndexedTrees[Slowest[i]].Duration);
+  }
+  std::vector<std::size_t> Slowest3;
+  Reader.getSlowestTrees(3, Slowest3);
+  ASSERT_EQ(3u, Slowest3.size());
+  for (std::size_t i = 0; i < 3; ++i)
+    EXPECT_EQ(Reader.IndexedTrees[Slowest[i]].Duration,
+              Reader.IndexedTrees[Slowest3[i]].Duration);
+}
+
+TEST(TemplightProtobufReaderTest, IndexVersion1) {
+  checkIndex({1, 0, false, true, false}, "");
+}
+
+TEST(TemplightProtobufReaderTest, IndexVersion2) {
+  checkIndex({2, 0, false, true, false}, "");
+}
+
+TEST(TemplightProtobufReaderTest, IndexChunked) {
+  checkIndex({1, 400, false, true, false}, "");
+  checkIndex({2, 400, false, true, false}, "");
+}
+
+TEST(TemplightProtobufReaderTest, IndexCompressed) {
+  checkIndex({1, 0, true, true, false}, "");
+  checkIndex({2, 400, true, true, false}, "");
+}
+
+TEST(TemplightProtobufReaderTest, IndexAfterOtherData) {
+  // Only the index of the last trace of concatenated files is found.
+  std::string Other = writeRandomTrace({2, 400, true, true, false}, 8, 10);
+  checkIndex({1, 0, false, true, false}, Other);
+  checkIndex({2, 400, true, true, false}, "junk" + Other);
+}
+
+// Gets the offsets of the frames of a framed trace, from their sync markers.
+std::vector<std::size_t> findFrames(llvm::StringRef Trace) {
+  char Marker[5];
+  Marker[0] = char(llvm::protobuf::getFixed64Wire<5>::value);
+  llvm::support::endian::write32le(Marker + 1,
+                                   TemplightProtobufWriter::FrameSyncMagic);
+  std::vector<std::size_t> Frames;
+  for (std::size_t Pos = Trace.find(llvm::StringRef(Marker, 5));
+       Pos != llvm::StringRef::npos;
+       Pos = Trace.find(llvm::StringRef(Marker, 5), Pos + 1))
+    Frames.push_back(Pos);
+  return Frames;
+}
+
+// Reads a damaged trace in recovery mode, with a "truncated" line (followed
+// by the OpenEntries) for each Truncated chunk.
+std::vector<std::string> recoverEntries(llvm::StringRef Trace) {
+  std::vector<std::string> Entries;
+  TemplightProtobufReader Reader;
+  Reader.setRecoveryMode(true);
+  for (Reader.startOnBuffer(Trace);
+       Reader.LastChunk != TemplightProtobufReader::EndOfFile;
+       Reader.next()) {
+    if (Reader.LastChunk == TemplightProtobufReader::Truncated) {
+      Entries.push_back("truncated");
+      for (const PrintableTemplightEntryBegin &Entry : Reader.OpenEntries)
+        Entries.push_back("open " + printBeginEntry(Entry));
+      continue;
+    }
+    std::string Entry = printEntry(Reader);
+    if (!Entry.empty())
+      Entries.push_back(Entry);
+  }
+  return Entries;
+}
+
+// Gets what recoverEntries should give for the entries that were kept:
+// the entries, and the begin entries whose end is missing at the end of
+// each trace.
+std::vector<std::string>
+getRecoveredEntries(const std::vector<std::string> &Entries) {
+  std::vector<std::string> Recovered;
+  std::vector<std::string> Open;
+  auto ReportTruncation = [&]() {
+    if (Open.empty())
+      return;
+    Recovered.push_back("truncated");
+    for (const std::string &Entry : Open)
+      Recovered.push_back("open " + Entry);
+    Open.clear();
+  };
+  for (const std::string &Entry : Entries) {
+    if (Entry.compare(0, 6, "trace ") == 0)
+      ReportTruncation();
+    else if (Entry.compare(0, 6, "begin ") == 0)
+      Open.push_back(Entry);
+    else if (!Open.empty())
+      Open.pop_back();
+    Recovered.push_back(Entry);
+  }
+  ReportTruncation();
+  return Recovered;
+}
+
+TEST(TemplightProtobufReaderTest, RecoverTruncatedTrace) {
+  for (unsigned Version : {1, 2}) {
+    std::string Trace =
+        writeRandomTrace({Version, 0, false, false, true}, 9, 5);
+    std::vector<std::string> Entries = readEntries(Trace);
+    std::vector<std::size_t> Frames = findFrames(Trace);
+    // The header, then one frame per entry.
+    ASSERT_EQ(Entries.size(), Frames.size());
+
+    for (std::size_t Cut = 1; Cut < Frames.size(); ++Cut) {
+      // The trace is cut in the middle of the frame of an entry, which is
+      // lost along with the entries that come after it.
+      std::size_t CutEnd =
+          (Cut + 1 < Frames.size() ? Frames[Cut + 1] : Trace.size());
+      llvm::StringRef CutTrace =
+          llvm::StringRef(Trace).take_front((Frames[Cut] + CutEnd) / 2);
+      std::vector<std::string> Kept(Entries.begin(), Entries.begin() + Cut);
+      EXPECT_EQ(getRecoveredEntries(Kept), recoverEntries(CutTrace))
+          << "version " << Version << ", cut in frame " << Cut;
+    }
+  }
+}
+
+TEST(TemplightProtobufReaderTest, RecoverTruncatedTraceBeforeNextTrace) {
+  std::string Trace = writeRandomTrace({2, 0, false, false, true}, 10, 5);
+  std::string Next =
+      writeRandomTrace({2, 0, false, false, true}, 11, 5, "b.cpp");
+  std::vector<std::string> Entries = readEntries(Trace);
+  std::vector<std::string> NextEntries = readEntries(Next);
+  std::vector<std::size_t> Frames = findFrames(Trace);
+  ASSERT_EQ(Entries.size(), Frames.size());
+
+  // The reader finds the sync marker of the next trace, and reports the
+  // truncation (once) before its header.
+  std::size_t Cut = Frames.size() / 2;
+  while (Entries[Cut].compare(0, 6, "begin ") != 0)
+    ++Cut; // cut short with an open entry, at least.
+  // Cut in the middle of the sync marker (a key and a fixed64).
+  std::string Damaged = Trace.substr(0, Frames[Cut] + 5) + Next;
+  std::vector<std::string> Kept(Entries.begin(), Entries.begin() + Cut);
+  Kept.insert(Kept.end(), NextEntries.begin(), NextEntries.end());
+  std::vector<std::string> Recovered = getRecoveredEntries(Kept);
+  ASSERT_EQ(1, std::count(Recovered.begin(), Recovered.end(), "truncated"));
+  EXPECT_EQ(Recovered, recoverEntries(Damaged));
+}
+
+TEST(TemplightProtobufReaderTest, RecoverCorruptedFrame) {
+  std::string Trace = writeRandomTrace({1, 0, false, false, true}, 12, 5);
+  std::vector<std::string> Entries = readEntries(Trace);
+  std::vector<std::size_t> Frames = findFrames(Trace);
+  ASSERT_EQ(Entries.size(), Frames.size());
+
+  // The frames of end entries hold no names, which later entries would need.
+  for (std::size_t Lost = 1; Lost + 1 < Frames.size(); ++Lost) {
+    if (Entries[Lost].compare(0, 4, "end ") != 0)
+      continue;
+    // Flip bytes of the frame, past its sync marker, key and length.
+    std::string Damaged = Trace;
+    for (std::size_t Pos = Frames[Lost] + 12; Pos < Frames[Lost + 1];
+         Pos += 3)
+      Damaged[Pos] ^= 0x5A;
+    std::vector<std::string> Kept = Entries;
+    Kept.erase(Kept.begin() + Lost);
+    EXPECT_EQ(getRecoveredEntries(Kept), recoverEntries(Damaged))
+        << "corrupted frame " << Lost;
+  }
+}
+
+} // namespace
@@ -0,0 +1,85 @@
+//===- ThinProtobufTest.cpp ------------------------*- C++ -*--------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "ThinProtobuf.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <cstdint>
+#include <string>
+
+using namespace llvm;
+
+TEST(ThinProtobufTest, FieldSizes) {
+  const std::uint64_t Values[] = {0,     1,          127,       128,
+                                  16383, 16384,      1ull << 35, ~0ull};
+  for (std::uint64_t V : Values) {
+    std::string Buf;
+    raw_string_ostream OS(Buf);
+    protobuf::saveVarInt(OS, 7, V);
+    OS.flush();
+    EXPECT_EQ(Buf.size(), protobuf::getVarIntFieldSize(7, V));
+
+    StringRef Ref(Buf);
+    EXPECT_EQ(7u << 3, protobuf::loadVarInt(Ref));
+    EXPECT_EQ(V, protobuf::loadVarInt(Ref));
+  }
+
+  std::string Buf;
+  raw_string_ostream OS(Buf);
+  protobuf::saveDouble(OS, 20, 1.5);
+  OS.flush();
+  EXPECT_EQ(Buf.size(), protobuf::getDoubleFieldSize(20));
+
+  Buf.clear();
+  protobuf::saveString(OS, 3, std::string(200, 'a'));
+  OS.flush();
+  EXPECT_EQ(Buf.size(), protobuf::getStringFieldSize(3, 200));
+}
+
+TEST(ThinProtobufTest, NestedMessageHeader) {
+  // A nested message written through its header must be identical to one
+  // encoded in a temporary buffer first.
+  std::string Inner;
+  raw_string_ostream OSInner(Inner);
+  protobuf::saveVarInt(OSInner, 1, 42);
+  protobuf::saveString(OSInner, 2, "name");
+  OSInner.flush();
+
+  std::string Expected;
+  raw_string_ostream OSExpected(Expected);
+  protobuf::saveString(OSExpected, 5, Inner);
+  OSExpected.flush();
+
+  std::string Direct;
+  raw_string_ostream OSDirect(Direct);
+  std::size_t InnerSize =
+      protobuf::getVarIntFieldSize(1, 42) + protobuf::getStringFieldSize(2, 4);
+  protobuf::saveStringHeader(OSDirect, 5, InnerSize);
+  protobuf::saveVarInt(OSDirect, 1, 42);
+  protobuf::saveString(OSDirect, 2, "name");
+  OSDirect.flush();
+
+  EXPECT_EQ(Expected, Direct);
+}
+
+TEST(ThinProtobufTest, Fixed64Field) {
+  // The index offset of a trace is found at a fixed distance from its end.
+  std::string Buf;
+  raw_string_ostream OS(Buf);
+  protobuf::saveFixed64(OS, 4, 0x0102030405060708ull);
+  OS.flush();
+  ASSERT_EQ(9u, Buf.size());
+
+  StringRef Ref(Buf);
+  EXPECT_EQ(std::uint64_t(protobuf::getFixed64Wire<4>::value),
+            protobuf::loadVarInt(Ref));
+  EXPECT_EQ(0x0102030405060708ull, protobuf::loadFixed64(Ref));
+  EXPECT_TRUE(Ref.empty());
+}
@@ -0,0 +1,66 @@
+//===- TemplightColumnarFormat.h --------------------*- C++ -*-------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TEMPLIGHT_COLUMNAR_FORMAT_H
+#define LLVM_CLANG_TEMPLIGHT_COLUMNAR_FORMAT_H
+
+#include <cstdint>
+
+namespace clang {
+
+namespace columnar {
+
+/*
+  A columnar trace is the magic string followed by sections, each one made of
+  a kind (one byte), the size of its payload (32 bits) and the payload. All
+  integers are little-endian.
+
+  HeaderSection:  the source file name (the rest of the payload), which
+                  starts a trace: the blocks up to the next header belong
+                  to it (one file can hold the traces of many sources).
+  NamesSection:   u32 count, then count times (u32 size, bytes), the names
+                  that follow the ones of the previous names sections.
+  FilesSection:   same as NamesSection, for the file names.
+  BlockSection:   u32 row count, then for each column (in Column order):
+                  u64 min, u64 max, u8 bit-width, and the (value - min) of
+                  each row packed in u64 words, starting at the low bits.
+
+  Each row is one instantiation, in the order of their begin entries, and
+  the dictionary sections always come before the first block using them.
+  The dictionaries go on from one trace to the next. Columnar files can be
+  concatenated: the magic string in place of a section kind starts over
+  with empty dictionaries.
+*/
+
+const char Magic[] = "TMPLCOL1";
+const unsigned MagicSize = 8;
+
+enum SectionKind : char {
+  HeaderSection = 'H',
+  NamesSection = 'N',
+  FilesSection = 'F',
+  BlockSection = 'B'
+};
+
+enum Column {
+  KindColumn,     // kind of synthesis.
+  NameColumn,     // id of the name.
+  FileColumn,     // id of the file of the point of instantiation.
+  LineColumn,     // line of the point of instantiation.
+  DepthColumn,    // nesting depth, from zero for top-level instantiations.
+  StartColumn,    // time-stamp of the begin entry, in nanoseconds.
+  DurationColumn, // time until the end entry, in nanoseconds.
+  NumColumns
+};
+
+} // namespace columnar
+
+} // namespace clang
+
+#endif
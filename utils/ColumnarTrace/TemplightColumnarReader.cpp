@@ -0,0 +1,169 @@
+//===- TemplightColumnarReader.cpp ------------*- C++ -*-------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightColumnarReader.h"
+
+#include <llvm/Support/Endian.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace clang {
+
+static bool loadUInt32(llvm::StringRef &p_buf, std::uint32_t &u) {
+  if (p_buf.size() < sizeof(u))
+    return false;
+  u = llvm::support::endian::read32le(p_buf.data());
+  p_buf = p_buf.drop_front(sizeof(u));
+  return true;
+}
+
+static bool loadUInt64(llvm::StringRef &p_buf, std::uint64_t &u) {
+  if (p_buf.size() < sizeof(u))
+    return false;
+  u = llvm::support::endian::read64le(p_buf.data());
+  p_buf = p_buf.drop_front(sizeof(u));
+  return true;
+}
+
+TemplightColumnarReader::TemplightColumnarReader()
+    : RowCount(0), TraceCount(0) {}
+
+bool TemplightColumnarReader::loadDictionary(llvm::StringRef aSubBuffer,
+                                             std::vector<std::string> &Map) {
+  std::uint32_t Count = 0;
+  if (!loadUInt32(aSubBuffer, Count))
+    return false;
+  for (std::uint32_t i = 0; i < Count; ++i) {
+    std::uint32_t Size = 0;
+    if (!loadUInt32(aSubBuffer, Size) || (aSubBuffer.size() < Size))
+      return false;
+    Map.push_back(aSubBuffer.take_front(Size).str());
+    aSubBuffer = aSubBuffer.drop_front(Size);
+  }
+  return true;
+}
+
+bool TemplightColumnarReader::loadBlock(llvm::StringRef aSubBuffer) {
+  std::uint32_t Rows = 0;
+  if (!loadUInt32(aSubBuffer, Rows))
+    return false;
+  RowCount = Rows;
+  for (unsigned C = 0; C < columnar::NumColumns; ++C) {
+    if (!loadUInt64(aSubBuffer, Stats[C].Min) ||
+        !loadUInt64(aSubBuffer, Stats[C].Max) || aSubBuffer.empty())
+      return false;
+    Widths[C] = static_cast<unsigned char>(aSubBuffer.front());
+    aSubBuffer = aSubBuffer.drop_front(1);
+    if (Widths[C] > 64)
+      return false;
+    std::size_t Words = (std::uint64_t(RowCount) * Widths[C] + 63) / 64;
+    if (aSubBuffer.size() < Words * sizeof(std::uint64_t))
+      return false;
+    Data[C] = aSubBuffer.take_front(Words * sizeof(std::uint64_t));
+    aSubBuffer = aSubBuffer.drop_front(Data[C].size());
+  }
+  return true;
+}
+
+bool TemplightColumnarReader::startOnBuffer(llvm::StringRef aBuffer) {
+  buffer = llvm::StringRef();
+  RowCount = 0;
+  TraceCount = 0;
+  SourceName.clear();
+  NameMap.clear();
+  FileNameMap.clear();
+  if (!aBuffer.starts_with(
+          llvm::StringRef(columnar::Magic, columnar::MagicSize)))
+    return false;
+  buffer = aBuffer.drop_front(columnar::MagicSize);
+  return true;
+}
+
+bool TemplightColumnarReader::nextBlock() {
+  RowCount = 0;
+  const llvm::StringRef Magic(columnar::Magic, columnar::MagicSize);
+  while (!buffer.empty()) {
+    if (buffer.starts_with(Magic)) {
+      // The start of a concatenated file, with dictionaries of its own.
+      buffer = buffer.drop_front(columnar::MagicSize);
+      NameMap.clear();
+      FileNameMap.clear();
+      continue;
+    }
+    char Kind = buffer.front();
+    buffer = buffer.drop_front(1);
+    std::uint32_t Size = 0;
+    if (!loadUInt32(buffer, Size) || (buffer.size() < Size))
+      break; // truncated trace.
+    llvm::StringRef SubBuffer = buffer.take_front(Size);
+    buffer = buffer.drop_front(Size);
+    switch (Kind) {
+    case columnar::HeaderSection:
+      SourceName = SubBuffer.str();
+      ++TraceCount;
+      break;
+    case columnar::NamesSection:
+      if (!loadDictionary(SubBuffer, NameMap))
+        buffer = llvm::StringRef();
+      break;
+    case columnar::FilesSection:
+      if (!loadDictionary(SubBuffer, FileNameMap))
+        buffer = llvm::StringRef();
+      break;
+    case columnar::BlockSection:
+      if (loadBlock(SubBuffer))
+        return true;
+      buffer = llvm::StringRef();
+      break;
+    default: // ignore for fwd-compat.
+      break;
+    }
+  }
+  buffer = llvm::StringRef();
+  RowCount = 0;
+  return false;
+}
+
+void TemplightColumnarReader::loadColumn(
+    columnar::Column C, std::vector<std::uint64_t> &Values) const {
+  Values.resize(RowCount);
+  const std::uint64_t Min = Stats[C].Min;
+  const unsigned Width = Widths[C];
+  if (Width == 0) {
+    std::fill(Values.begin(), Values.end(), Min);
+    return;
+  }
+
+  const char *Words = Data[C].data();
+  const std::uint64_t Mask = (Width == 64 ? ~std::uint64_t(0)
+                                          : (std::uint64_t(1) << Width) - 1);
+  std::uint64_t Word = 0;
+  unsigned Avail = 0; // number of bits left in Word.
+  for (std::size_t i = 0; i < RowCount; ++i) {
+    std::uint64_t Value;
+    if (Avail >= Width) {
+      Value = Word;
+      Word = (Width == 64 ? 0 : Word >> Width);
+      Avail -= Width;
+    } else {
+      // The value straddles two words.
+      std::uint64_t Next = llvm::support::endian::read64le(Words);
+      Words += sizeof(std::uint64_t);
+      Value = (Avail > 0 ? Word | (Next << Avail) : Next);
+      unsigned Taken = Width - Avail;
+      Word = (Taken == 64 ? 0 : Next >> Taken);
+      Avail = 64 - Taken;
+    }
+    Values[i] = Min + (Value & Mask);
+  }
+}
+
+} // namespace clang
@@ -0,0 +1,75 @@
+//===- TemplightColumnarReader.h --------------------*- C++ -*-------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TEMPLIGHT_COLUMNAR_READER_H
+#define LLVM_CLANG_TEMPLIGHT_COLUMNAR_READER_H
+
+#include "TemplightColumnarFormat.h"
+
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+/// \brief Reads a columnar trace one block at a time. The statistics of a
+/// block are available as soon as it is reached, and its columns are only
+/// decoded when they are loaded, such that a query can skip the blocks that
+/// cannot match and only decode the columns it uses.
+class TemplightColumnarReader {
+public:
+  struct ColumnStats {
+    std::uint64_t Min;
+    std::uint64_t Max;
+  };
+
+private:
+  llvm::StringRef buffer;
+
+  std::size_t RowCount;
+  std::size_t TraceCount;
+  ColumnStats Stats[columnar::NumColumns];
+  unsigned Widths[columnar::NumColumns];
+  llvm::StringRef Data[columnar::NumColumns];
+
+  bool loadDictionary(llvm::StringRef aSubBuffer,
+                      std::vector<std::string> &Map);
+  bool loadBlock(llvm::StringRef aSubBuffer);
+
+public:
+  std::string SourceName; // of the trace of the current block.
+  std::vector<std::string> NameMap;
+  std::vector<std::string> FileNameMap;
+
+  TemplightColumnarReader();
+
+  /// \brief Starts reading a columnar trace, returns false if the buffer
+  /// does not contain one.
+  bool startOnBuffer(llvm::StringRef aBuffer);
+
+  /// \brief Moves to the next block of rows (reading the dictionaries on the
+  /// way), returns false at the end of the trace.
+  bool nextBlock();
+
+  std::size_t getRowCount() const { return RowCount; }
+
+  /// \brief Gets the index of the trace of the current block, in the order
+  /// of their headers (from zero), whose source file is the SourceName.
+  std::size_t getTraceIndex() const { return TraceCount - 1; }
+  const ColumnStats &getStats(columnar::Column C) const { return Stats[C]; }
+
+  /// \brief Decodes one column of the current block into \p Values.
+  void loadColumn(columnar::Column C, std::vector<std::uint64_t> &Values) const;
+};
+
+} // namespace clang
+
+#endif
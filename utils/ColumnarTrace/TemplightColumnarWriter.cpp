@@ -0,0 +1,179 @@
+//===- TemplightColumnarWriter.cpp ------------*- C++ -*-------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightColumnarWriter.h"
+
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+namespace clang {
+
+static void saveUInt32(llvm::raw_ostream &OS, std::uint32_t u) {
+  u = llvm::support::endian::byte_swap<std::uint32_t,
+                                       llvm::endianness::little>(u);
+  OS.write(reinterpret_cast<const char *>(&u), sizeof(u));
+}
+
+static void saveUInt64(llvm::raw_ostream &OS, std::uint64_t u) {
+  u = llvm::support::endian::byte_swap<std::uint64_t,
+                                       llvm::endianness::little>(u);
+  OS.write(reinterpret_cast<const char *>(&u), sizeof(u));
+}
+
+static std::uint64_t getTimeStampNS(double TimeStamp) {
+  return (TimeStamp > 0.0 ? std::uint64_t(std::llround(TimeStamp * 1e9)) : 0);
+}
+
+TemplightColumnarWriter::TemplightColumnarWriter(llvm::raw_ostream &aOS,
+                                                 std::size_t aBlockRows)
+    : TemplightWriter(aOS), blockRows(std::max<std::size_t>(aBlockRows, 1)) {
+  OutputOS.write(columnar::Magic, columnar::MagicSize);
+}
+
+TemplightColumnarWriter::~TemplightColumnarWriter() {}
+
+std::size_t
+TemplightColumnarWriter::getId(llvm::StringMap<std::size_t> &Map,
+                               std::vector<llvm::StringRef> &NewKeys,
+                               const std::string &Key) {
+  std::pair<llvm::StringMap<std::size_t>::iterator, bool> Res =
+      Map.try_emplace(Key, Map.size());
+  if (Res.second)
+    NewKeys.push_back(Res.first->getKey()); // owned by the map.
+  return Res.first->second;
+}
+
+void TemplightColumnarWriter::writeSection(columnar::SectionKind Kind) {
+  OutputOS << char(Kind);
+  saveUInt32(OutputOS, section.size());
+  OutputOS << section;
+  section.clear();
+}
+
+void TemplightColumnarWriter::writeDictionary(
+    columnar::SectionKind Kind, std::vector<llvm::StringRef> &NewKeys) {
+  if (NewKeys.empty())
+    return;
+  {
+    llvm::raw_string_ostream OS(section);
+    saveUInt32(OS, NewKeys.size());
+    for (llvm::StringRef Key : NewKeys) {
+      saveUInt32(OS, Key.size());
+      OS << Key;
+    }
+  }
+  writeSection(Kind);
+  NewKeys.clear();
+}
+
+void TemplightColumnarWriter::writeBlock(std::size_t Lo, std::size_t Hi) {
+  // The names and files used by the block go out before it.
+  writeDictionary(columnar::NamesSection, newNames);
+  writeDictionary(columnar::FilesSection, newFileNames);
+
+  llvm::raw_string_ostream OS(section);
+  saveUInt32(OS, Hi - Lo);
+  for (unsigned C = 0; C < columnar::NumColumns; ++C) {
+    std::uint64_t Min = rows[Lo].Values[C];
+    std::uint64_t Max = Min;
+    for (std::size_t i = Lo + 1; i < Hi; ++i) {
+      Min = std::min(Min, rows[i].Values[C]);
+      Max = std::max(Max, rows[i].Values[C]);
+    }
+    unsigned Width = 0;
+    while ((Width < 64) && ((Max - Min) >> Width))
+      ++Width;
+    saveUInt64(OS, Min);
+    saveUInt64(OS, Max);
+    OS << char(Width);
+    if (Width == 0)
+      continue; // all the values are the minimum.
+
+    // Pack the values into words, from the low bits up.
+    std::uint64_t Word = 0;
+    unsigned Used = 0;
+    for (std::size_t i = Lo; i < Hi; ++i) {
+      std::uint64_t Value = rows[i].Values[C] - Min;
+      Word |= Value << Used;
+      Used += Width;
+      if (Used >= 64) {
+        saveUInt64(OS, Word);
+        Used -= 64;
+        Word = (Used > 0 ? Value >> (Width - Used) : 0);
+      }
+    }
+    if (Used > 0)
+      saveUInt64(OS, Word);
+  }
+  OS.flush();
+  writeSection(columnar::BlockSection);
+}
+
+void TemplightColumnarWriter::flushRows(bool Final) {
+  // NOTE: This is only called between top-level instantiations, when all the
+  // pending rows are complete.
+  std::size_t Lo = 0;
+  while ((rows.size() - Lo >= blockRows) || (Final && (Lo < rows.size()))) {
+    std::size_t Hi = std::min(Lo + blockRows, rows.size());
+    writeBlock(Lo, Hi);
+    Lo = Hi;
+  }
+  rows.erase(rows.begin(), rows.begin() + Lo);
+}
+
+void TemplightColumnarWriter::initialize(const std::string &aSourceName) {
+  // Each trace starts with its header, the dictionaries go on from the
+  // previous traces.
+  openRows.clear();
+  section = aSourceName;
+  writeSection(columnar::HeaderSection);
+}
+
+void TemplightColumnarWriter::finalize() {
+  // Instantiations that never ended (e.g., after a fatal error) are kept
+  // with a zero duration.
+  openRows.clear();
+  flushRows(true);
+  OutputOS.flush();
+}
+
+void TemplightColumnarWriter::printEntry(
+    const PrintableTemplightEntryBegin &aEntry) {
+  Row R;
+  R.Values[columnar::KindColumn] = aEntry.SynthesisKind;
+  R.Values[columnar::NameColumn] = getId(nameMap, newNames, aEntry.Name);
+  R.Values[columnar::FileColumn] =
+      getId(fileNameMap, newFileNames, aEntry.FileName);
+  R.Values[columnar::LineColumn] = aEntry.Line;
+  R.Values[columnar::DepthColumn] = openRows.size();
+  R.Values[columnar::StartColumn] = getTimeStampNS(aEntry.TimeStamp);
+  R.Values[columnar::DurationColumn] = 0;
+  openRows.push_back(rows.size());
+  rows.push_back(R);
+}
+
+void TemplightColumnarWriter::printEntry(
+    const PrintableTemplightEntryEnd &aEntry) {
+  if (openRows.empty())
+    return;
+  Row &R = rows[openRows.back()];
+  openRows.pop_back();
+  std::uint64_t End = getTimeStampNS(aEntry.TimeStamp);
+  std::uint64_t Start = R.Values[columnar::StartColumn];
+  R.Values[columnar::DurationColumn] = (End > Start ? End - Start : 0);
+  if (openRows.empty())
+    flushRows(false);
+}
+
+} // namespace clang
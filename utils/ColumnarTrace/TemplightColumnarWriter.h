@@ -0,0 +1,66 @@
+//===- TemplightColumnarWriter.h --------------------*- C++ -*-------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TEMPLIGHT_COLUMNAR_WRITER_H
+#define LLVM_CLANG_TEMPLIGHT_COLUMNAR_WRITER_H
+
+#include "PrintableTemplightEntries.h"
+#include "TemplightColumnarFormat.h"
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace clang {
+
+/// \brief Writes the trace as blocks of bit-packed columns (one row per
+/// instantiation), with the minimum and maximum of each column in the block,
+/// such that queries can skip blocks and decode only the columns they need.
+class TemplightColumnarWriter : public TemplightWriter {
+private:
+  struct Row {
+    std::uint64_t Values[columnar::NumColumns];
+  };
+
+  std::vector<Row> rows;             // pending rows, in order of beginning.
+  std::vector<std::size_t> openRows; // rows waiting for their end entry.
+  std::size_t blockRows;
+  llvm::StringMap<std::size_t> nameMap;
+  llvm::StringMap<std::size_t> fileNameMap;
+  std::vector<llvm::StringRef> newNames; // not yet written out.
+  std::vector<llvm::StringRef> newFileNames;
+  std::string section;
+
+  std::size_t getId(llvm::StringMap<std::size_t> &Map,
+                    std::vector<llvm::StringRef> &NewKeys,
+                    const std::string &Key);
+  void writeSection(columnar::SectionKind Kind);
+  void writeDictionary(columnar::SectionKind Kind,
+                       std::vector<llvm::StringRef> &NewKeys);
+  void writeBlock(std::size_t Lo, std::size_t Hi);
+  void flushRows(bool Final);
+
+public:
+  TemplightColumnarWriter(llvm::raw_ostream &aOS,
+                          std::size_t aBlockRows = 65536);
+  ~TemplightColumnarWriter();
+
+  void initialize(const std::string &aSourceName = "") override;
+  void finalize() override;
+
+  void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
+  void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+};
+
+} // namespace clang
+
+#endif
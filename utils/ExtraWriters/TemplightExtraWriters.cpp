@@ -9,12 +9,23 @@
 
 #include "TemplightExtraWriters.h"
 
-#include <clang/Sema/ActiveTemplateInst.h>
-
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/Twine.h>
 #include <llvm/Support/Format.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/YAMLParser.h>
 #include <llvm/Support/YAMLTraits.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <tuple>
+
 namespace clang {
 
 static const char *const SynthesisKindStrings[] = {
@@ -65,104 +76,136 @@ static std::string escapeXml(const std::string &Input) {
   return Result;
 }
 
-} // namespace clang
-namespace llvm {
-namespace yaml {
-
-template <>
-struct ScalarEnumerationTraits<
-    clang::Sema::CodeSynthesisContext::SynthesisKind> {
-  static void
-  enumeration(IO &io, clang::Sema::CodeSynthesisContext::SynthesisKind &value) {
-
-#define def_enum_case(e) io.enumCase(value, SynthesisKindStrings[e], e)
-
-    using namespace clang;
-    def_enum_case(CodeSynthesisContext::TemplateInstantiation);
-    def_enum_case(CodeSynthesisContext::DefaultTemplateArgumentInstantiation);
-    def_enum_case(CodeSynthesisContext::DefaultFunctionArgumentInstantiation);
-    def_enum_case(CodeSynthesisContext::ExplicitTemplateArgumentSubstitution);
-    def_enum_case(CodeSynthesisContext::DeducedTemplateArgumentSubstitution);
-    def_enum_case(CodeSynthesisContext::PriorTemplateArgumentSubstitution);
-    def_enum_case(CodeSynthesisContext::DefaultTemplateArgumentChecking);
-    def_enum_case(CodeSynthesisContext::ExceptionSpecInstantiation);
-    def_enum_case(CodeSynthesisContext::DeclaringSpecialMember);
-    def_enum_case(CodeSynthesisContext::DefiningSynthesizedFunction);
-    def_enum_case(CodeSynthesisContext::Memoization);
-
-#undef def_enum_case
+// Writes a key of an entry (the first one opens the entry), padded as
+// llvm::yaml::Output does.
+static void writeYamlKey(llvm::raw_ostream &OS, llvm::StringRef Key,
+                         bool First = false) {
+  OS << (First ? "\n- " : "\n  ") << Key << ':';
+  OS.indent(Key.size() < 16 ? 16 - Key.size() : 1);
+}
+
+// Writes the contents of a single-quoted scalar.
+static void writeYamlSingleQuoted(llvm::raw_ostream &OS, llvm::StringRef S) {
+  std::size_t pos;
+  while ((pos = S.find('\'')) != llvm::StringRef::npos) {
+    OS << S.substr(0, pos + 1) << '\'';
+    S = S.substr(pos + 1);
   }
-};
+  OS << S;
+}
 
-template <> struct MappingTraits<clang::PrintableTemplightEntryBegin> {
-  static void mapping(IO &io, clang::PrintableTemplightEntryBegin &Entry) {
-    bool b = true;
-    io.mapRequired("IsBegin", b);
-    // must be converted to string before, due to some BS with yaml traits.
-    std::string kind = clang::SynthesisKindStrings[Entry.SynthesisKind];
-    io.mapRequired("Kind", kind);
-    io.mapOptional("Name", Entry.Name);
-    std::string loc = Entry.FileName + "|" + std::to_string(Entry.Line) + "|" +
-                      std::to_string(Entry.Column);
-    io.mapOptional("Location", loc);
-    io.mapRequired("TimeStamp", Entry.TimeStamp);
-    io.mapOptional("MemoryUsage", Entry.MemoryUsage);
-    std::string ori = Entry.TempOri_FileName + "|" +
-                      std::to_string(Entry.TempOri_Line) + "|" +
-                      std::to_string(Entry.TempOri_Column);
-    io.mapOptional("TemplateOrigin", ori);
+// Gets the quoting of a string scalar, as llvm::yaml::needsQuotes does, but
+// in one pass for the strings that have a character that needs quotes (e.g.,
+// the names with angle brackets), which are most of them.
+static llvm::yaml::QuotingType getYamlQuoting(llvm::StringRef S) {
+  bool NeedsQuotes = false;
+  for (unsigned char C : S) {
+    if (C >= 0x80 || C == 0x7F || (C <= 0x1F && C != '\t'))
+      return llvm::yaml::QuotingType::Double;
+    if (!llvm::isAlnum(C) && C != '_' && C != '-' && C != '^' && C != '.' &&
+        C != ',' && C != ' ' && C != '\t')
+      NeedsQuotes = true;
   }
-};
+  if (NeedsQuotes)
+    return llvm::yaml::QuotingType::Single;
+  return llvm::yaml::needsQuotes(S); // for the numbers, booleans, etc.
+}
 
-template <> struct MappingTraits<clang::PrintableTemplightEntryEnd> {
-  static void mapping(IO &io, clang::PrintableTemplightEntryEnd &Entry) {
-    bool b = false;
-    io.mapRequired("IsBegin", b);
-    io.mapRequired("TimeStamp", Entry.TimeStamp);
-    io.mapOptional("MemoryUsage", Entry.MemoryUsage);
+// Writes a string scalar, quoted as llvm::yaml::Output does.
+static void writeYamlString(llvm::raw_ostream &OS, llvm::StringRef S) {
+  switch (getYamlQuoting(S)) {
+  case llvm::yaml::QuotingType::None:
+    OS << S;
+    break;
+  case llvm::yaml::QuotingType::Single:
+    OS << '\'';
+    writeYamlSingleQuoted(OS, S);
+    OS << '\'';
+    break;
+  case llvm::yaml::QuotingType::Double:
+    OS << '"' << llvm::yaml::escape(S, /*EscapePrintable=*/false) << '"';
+    break;
   }
-};
+}
 
-} // namespace yaml
-} // namespace llvm
-namespace clang {
+// Writes a "file|line|column" scalar, which always needs quotes (for the
+// '|'), and only needs double quotes for the same file names as on their own.
+static void writeYamlLocation(llvm::raw_ostream &OS, llvm::StringRef FileName,
+                              int Line, int Column) {
+  if (getYamlQuoting(FileName) != llvm::yaml::QuotingType::Double) {
+    OS << '\'';
+    writeYamlSingleQuoted(OS, FileName);
+    OS << '|' << Line << '|' << Column << '\'';
+    return;
+  }
+  writeYamlString(OS, (FileName + "|" + llvm::Twine(Line) + "|" +
+                       llvm::Twine(Column))
+                          .str());
+}
+
+// Writes a floating-point scalar, as "%g" (like llvm::yaml::Output), but with
+// std::to_chars when the library has it, which is much faster than printf.
+static void writeYamlDouble(llvm::raw_ostream &OS, double Value) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  char Buffer[32];
+  std::to_chars_result Res =
+      std::to_chars(Buffer, Buffer + sizeof(Buffer), Value,
+                    std::chars_format::general, 6);
+  OS.write(Buffer, Res.ptr - Buffer);
+#else
+  OS << llvm::format("%g", Value);
+#endif
+}
 
 void TemplightYamlWriter::initialize(const std::string &aSourceName) {
-  Output->beginSequence();
+  emptySequence = true;
 }
 
-void TemplightYamlWriter::finalize() { Output->endSequence(); }
+void TemplightYamlWriter::finalize() {
+  if (emptySequence)
+    OutputOS << "\n[]";
+}
 
 void TemplightYamlWriter::printEntry(
     const PrintableTemplightEntryBegin &Entry) {
-  void *SaveInfo;
-  if (Output->preflightElement(1, SaveInfo)) {
-    llvm::yaml::EmptyContext Context;
-    llvm::yaml::yamlize(*Output,
-                        const_cast<PrintableTemplightEntryBegin &>(Entry), true,
-                        Context);
-    Output->postflightElement(SaveInfo);
-  }
+  emptySequence = false;
+  writeYamlKey(OutputOS, "IsBegin", true);
+  OutputOS << "true";
+  writeYamlKey(OutputOS, "Kind");
+  OutputOS << SynthesisKindStrings[Entry.SynthesisKind];
+  writeYamlKey(OutputOS, "Name");
+  writeYamlString(OutputOS, Entry.Name);
+  writeYamlKey(OutputOS, "Location");
+  writeYamlLocation(OutputOS, Entry.FileName, Entry.Line, Entry.Column);
+  writeYamlKey(OutputOS, "TimeStamp");
+  writeYamlDouble(OutputOS, Entry.TimeStamp);
+  writeYamlKey(OutputOS, "MemoryUsage");
+  OutputOS << Entry.MemoryUsage;
+  writeYamlKey(OutputOS, "TemplateOrigin");
+  writeYamlLocation(OutputOS, Entry.TempOri_FileName, Entry.TempOri_Line,
+                    Entry.TempOri_Column);
 }
 
 void TemplightYamlWriter::printEntry(const PrintableTemplightEntryEnd &Entry) {
-  void *SaveInfo;
-  if (Output->preflightElement(1, SaveInfo)) {
-    llvm::yaml::EmptyContext Context;
-    llvm::yaml::yamlize(*Output,
-                        const_cast<PrintableTemplightEntryEnd &>(Entry), true,
-                        Context);
-    Output->postflightElement(SaveInfo);
+  emptySequence = false;
+  writeYamlKey(OutputOS, "IsBegin", true);
+  OutputOS << "false";
+  writeYamlKey(OutputOS, "TimeStamp");
+  writeYamlDouble(OutputOS, Entry.TimeStamp);
+  writeYamlKey(OutputOS, "MemoryUsage");
+  OutputOS << Entry.MemoryUsage;
+  if (Entry.PrunedChildrenTime != 0.0) {
+    writeYamlKey(OutputOS, "PrunedChildrenTime");
+    writeYamlDouble(OutputOS, Entry.PrunedChildrenTime);
   }
 }
 
 TemplightYamlWriter::TemplightYamlWriter(llvm::raw_ostream &aOS)
-    : TemplightWriter(aOS) {
-  Output.reset(new llvm::yaml::Output(OutputOS));
-  Output->beginDocuments();
+    : TemplightWriter(aOS), emptySequence(true) {
+  OutputOS << "---";
 }
 
-TemplightYamlWriter::~TemplightYamlWriter() { Output->endDocuments(); }
+TemplightYamlWriter::~TemplightYamlWriter() { OutputOS << "\n...\n"; }
 
 TemplightXmlWriter::TemplightXmlWriter(llvm::raw_ostream &aOS)
     : TemplightWriter(aOS) {
@@ -201,9 +244,33 @@ void TemplightXmlWriter::printEntry(
 void TemplightXmlWriter::printEntry(const PrintableTemplightEntryEnd &aEntry) {
   OutputOS << llvm::format("<TemplateEnd>\n"
                            "    <TimeStamp time = \"%.9f\"/>\n"
-                           "    <MemoryUsage bytes = \"%d\"/>\n"
-                           "</TemplateEnd>\n",
+                           "    <MemoryUsage bytes = \"%d\"/>\n",
                            aEntry.TimeStamp, aEntry.MemoryUsage);
+  if (aEntry.PrunedChildrenTime > 0.0) {
+    OutputOS << llvm::format("    <PrunedChildrenTime time = \"%.9f\"/>\n",
+                             aEntry.PrunedChildrenTime);
+  }
+  OutputOS << "</TemplateEnd>\n";
+}
+
+void TemplightXmlWriter::printSummary(
+    const PrintableTemplightSummaryEntry &aEntry) {
+  std::string EscapedName = escapeXml(aEntry.Name);
+  OutputOS << llvm::format("<TemplateSummary>\n"
+                           "    <Kind>%s</Kind>\n"
+                           "    <Context context = \"%s\"/>\n"
+                           "    <Location>%s|%d|%d</Location>\n",
+                           SynthesisKindStrings[aEntry.SynthesisKind],
+                           EscapedName.c_str(), aEntry.FileName.c_str(),
+                           aEntry.Line, aEntry.Column);
+  OutputOS << llvm::format("    <Count>%llu</Count>\n"
+                           "    <InclusiveTime time = \"%.9f\"/>\n"
+                           "    <ExclusiveTime time = \"%.9f\"/>\n"
+                           "    <MaxDepth>%u</MaxDepth>\n"
+                           "</TemplateSummary>\n",
+                           (unsigned long long)aEntry.Count,
+                           aEntry.InclusiveTime, aEntry.ExclusiveTime,
+                           aEntry.MaxDepth);
 }
 
 TemplightTextWriter::TemplightTextWriter(llvm::raw_ostream &aOS)
@@ -241,6 +308,28 @@ void TemplightTextWriter::printEntry(const PrintableTemplightEntryEnd &aEntry) {
                            "  TimeStamp = %.9f\n"
                            "  MemoryUsage = %d\n",
                            aEntry.TimeStamp, aEntry.MemoryUsage);
+  if (aEntry.PrunedChildrenTime > 0.0) {
+    OutputOS << llvm::format("  PrunedChildrenTime = %.9f\n",
+                             aEntry.PrunedChildrenTime);
+  }
+}
+
+void TemplightTextWriter::printSummary(
+    const PrintableTemplightSummaryEntry &aEntry) {
+  OutputOS << llvm::format("TemplateSummary\n"
+                           "  Kind = %s\n"
+                           "  Name = %s\n"
+                           "  Location = %s|%d|%d\n",
+                           SynthesisKindStrings[aEntry.SynthesisKind],
+                           aEntry.Name.c_str(), aEntry.FileName.c_str(),
+                           aEntry.Line, aEntry.Column);
+  OutputOS << llvm::format("  Count = %llu\n"
+                           "  InclusiveTime = %.9f\n"
+                           "  ExclusiveTime = %.9f\n"
+                           "  MaxDepth = %u\n",
+                           (unsigned long long)aEntry.Count,
+                           aEntry.InclusiveTime, aEntry.ExclusiveTime,
+                           aEntry.MaxDepth);
 }
 
 struct EntryTraversalTask {
@@ -248,50 +337,56 @@ struct EntryTraversalTask {
 
   PrintableTemplightEntryBegin start;
   PrintableTemplightEntryEnd finish;
-  std::size_t nd_id, id_end, parent_id;
-  EntryTraversalTask(const PrintableTemplightEntryBegin &aStart,
-                     std::size_t aNdId, std::size_t aParentId)
-      : start(aStart), finish(), nd_id(aNdId), id_end(invalid_id),
-        parent_id(aParentId){};
+  std::size_t nd_id, parent_id;
 };
 
-struct RecordedDFSEntryTree {
-  static const std::size_t invalid_id = ~std::size_t(0);
-
-  std::vector<EntryTraversalTask> parent_stack;
-  std::size_t cur_top;
-
-  RecordedDFSEntryTree() : cur_top(invalid_id){};
-
-  void beginEntry(const PrintableTemplightEntryBegin &aEntry) {
-    parent_stack.push_back(
-        EntryTraversalTask(aEntry, parent_stack.size(),
-                           (cur_top == invalid_id ? invalid_id : cur_top)));
-    cur_top = parent_stack.size() - 1;
+struct OpenDFSEntryStack {
+  // NOTE: The slots above the depth are kept, such that assigning the next
+  // entries to them reuses the capacity of their strings.
+  std::vector<EntryTraversalTask> open_nodes;
+  std::size_t depth;
+  std::size_t next_id; // the nodes are numbered in DFS pre-order.
+  PrintableTemplightEntryEnd last_end; // the latest time and memory seen.
+
+  OpenDFSEntryStack() : depth(0), next_id(0), last_end(){};
+
+  EntryTraversalTask &beginEntry(const PrintableTemplightEntryBegin &aEntry) {
+    if (depth == open_nodes.size())
+      open_nodes.emplace_back();
+    EntryTraversalTask &Node = open_nodes[depth];
+    Node.start = aEntry;
+    Node.nd_id = next_id++;
+    Node.parent_id = (depth == 0 ? EntryTraversalTask::invalid_id
+                                 : open_nodes[depth - 1].nd_id);
+    ++depth;
+    last_end.TimeStamp = aEntry.TimeStamp;
+    last_end.MemoryUsage = aEntry.MemoryUsage;
+    return Node;
   };
 
-  void endEntry(const PrintableTemplightEntryEnd &aEntry) {
-    parent_stack[cur_top].finish = aEntry;
-    parent_stack[cur_top].id_end = parent_stack.size();
-    if (parent_stack[cur_top].parent_id == invalid_id)
-      cur_top = invalid_id;
-    else
-      cur_top = parent_stack[cur_top].parent_id;
+  // The node remains valid until the next begin entry.
+  EntryTraversalTask &endEntry(const PrintableTemplightEntryEnd &aEntry) {
+    EntryTraversalTask &Node = open_nodes[--depth];
+    Node.finish = aEntry;
+    last_end = aEntry;
+    return Node;
   };
 };
 
 TemplightTreeWriter::TemplightTreeWriter(llvm::raw_ostream &aOS)
-    : TemplightWriter(aOS), p_tree(new RecordedDFSEntryTree()) {}
+    : TemplightWriter(aOS), p_stack(new OpenDFSEntryStack()) {}
 
 TemplightTreeWriter::~TemplightTreeWriter() {}
 
 void TemplightTreeWriter::printEntry(
     const PrintableTemplightEntryBegin &aEntry) {
-  p_tree->beginEntry(aEntry);
+  openPrintedTreeNode(p_stack->beginEntry(aEntry));
 }
 
 void TemplightTreeWriter::printEntry(const PrintableTemplightEntryEnd &aEntry) {
-  p_tree->endEntry(aEntry);
+  if (p_stack->depth == 0)
+    return; // an end without a begin.
+  closePrintedTreeNode(p_stack->endEntry(aEntry));
 }
 
 void TemplightTreeWriter::initialize(const std::string &aSourceName) {
@@ -299,27 +394,45 @@ void TemplightTreeWriter::initialize(const std::string &aSourceName) {
 }
 
 void TemplightTreeWriter::finalize() {
-  std::vector<std::size_t> open_set;
-  std::vector<EntryTraversalTask> &tree = p_tree->parent_stack;
-
-  for (std::size_t i = 0, i_end = tree.size(); i != i_end; ++i) {
-    while (!open_set.empty() && (i >= tree[open_set.back()].id_end)) {
-      closePrintedTreeNode(tree[open_set.back()]);
-      open_set.pop_back();
-    }
-    openPrintedTreeNode(tree[i]);
-    open_set.push_back(i);
-  }
-  while (!open_set.empty()) {
-    closePrintedTreeNode(tree[open_set.back()]);
-    open_set.pop_back();
+  // The nodes that never ended (e.g., after a fatal error) run to the end.
+  while (p_stack->depth > 0) {
+    PrintableTemplightEntryEnd LastEnd = p_stack->last_end;
+    LastEnd.PrunedChildrenTime = 0.0;
+    closePrintedTreeNode(p_stack->endEntry(LastEnd));
   }
 
   this->finalizeTree();
 }
 
+// Prints the <Entry> tag up to its cost attributes (and without its '>').
+static void printXmlEntryHeading(llvm::raw_ostream &OS,
+                                 const PrintableTemplightEntryBegin &BegEntry) {
+  std::string EscapedName = escapeXml(BegEntry.Name);
+
+  OS << llvm::format("<Entry Kind=\"%s\" Name=\"%s\" ",
+                     SynthesisKindStrings[BegEntry.SynthesisKind],
+                     EscapedName.c_str());
+  OS << llvm::format("Location=\"%s|%d|%d\"", BegEntry.FileName.c_str(),
+                     BegEntry.Line, BegEntry.Column);
+  if (!BegEntry.TempOri_FileName.empty()) {
+    OS << llvm::format(" TemplateOrigin=\"%s|%d|%d\"",
+                       BegEntry.TempOri_FileName.c_str(), BegEntry.TempOri_Line,
+                       BegEntry.TempOri_Column);
+  }
+}
+
+struct BufferedDFSEntryTree {
+  // NOTE: The slots past the size are kept, as in OpenDFSEntryStack.
+  std::vector<EntryTraversalTask> nodes;
+  std::vector<std::size_t> id_ends; // one past the last descendant.
+  std::vector<std::size_t> open_set;
+  std::size_t size;
+
+  BufferedDFSEntryTree() : size(0){};
+};
+
 TemplightNestedXMLWriter::TemplightNestedXMLWriter(llvm::raw_ostream &aOS)
-    : TemplightTreeWriter(aOS) {
+    : TemplightTreeWriter(aOS), p_tree(new BufferedDFSEntryTree()) {
   OutputOS << "<?xml version=\"1.0\" standalone=\"yes\"?>\n";
 }
 
@@ -333,29 +446,76 @@ void TemplightNestedXMLWriter::finalizeTree() { OutputOS << "</Trace>\n"; }
 
 void TemplightNestedXMLWriter::openPrintedTreeNode(
     const EntryTraversalTask &aNode) {
-  const PrintableTemplightEntryBegin &BegEntry = aNode.start;
-  const PrintableTemplightEntryEnd &EndEntry = aNode.finish;
-  std::string EscapedName = escapeXml(BegEntry.Name);
+  // The cost of an element is only known at its end, so the nodes are kept
+  // until their top-level node ends.
+  BufferedDFSEntryTree &Tree = *p_tree;
+  if (Tree.size == Tree.nodes.size()) {
+    Tree.nodes.emplace_back();
+    Tree.id_ends.emplace_back();
+  }
+  Tree.nodes[Tree.size] = aNode;
+  Tree.open_set.push_back(Tree.size);
+  ++Tree.size;
+}
 
-  OutputOS << llvm::format("<Entry Kind=\"%s\" Name=\"%s\" ",
-                           SynthesisKindStrings[BegEntry.SynthesisKind],
-                           EscapedName.c_str());
-  OutputOS << llvm::format("Location=\"%s|%d|%d\" ", BegEntry.FileName.c_str(),
-                           BegEntry.Line, BegEntry.Column);
-  if (!BegEntry.TempOri_FileName.empty()) {
-    OutputOS << llvm::format("TemplateOrigin=\"%s|%d|%d\" ",
-                             BegEntry.TempOri_FileName.c_str(),
-                             BegEntry.TempOri_Line, BegEntry.TempOri_Column);
+void TemplightNestedXMLWriter::closePrintedTreeNode(
+    const EntryTraversalTask &aNode) {
+  BufferedDFSEntryTree &Tree = *p_tree;
+  Tree.nodes[Tree.open_set.back()].finish = aNode.finish;
+  Tree.id_ends[Tree.open_set.back()] = Tree.size;
+  Tree.open_set.pop_back();
+  if (!Tree.open_set.empty())
+    return;
+
+  for (std::size_t i = 0; i != Tree.size; ++i) {
+    while (!Tree.open_set.empty() &&
+           (i >= Tree.id_ends[Tree.open_set.back()])) {
+      OutputOS << "</Entry>\n";
+      Tree.open_set.pop_back();
+    }
+    const PrintableTemplightEntryBegin &BegEntry = Tree.nodes[i].start;
+    const PrintableTemplightEntryEnd &EndEntry = Tree.nodes[i].finish;
+    printXmlEntryHeading(OutputOS, BegEntry);
+    OutputOS << llvm::format(" Time=\"%.9f\" Memory=\"%d\">\n",
+                             EndEntry.TimeStamp - BegEntry.TimeStamp,
+                             EndEntry.MemoryUsage - BegEntry.MemoryUsage);
+    Tree.open_set.push_back(i);
   }
-  OutputOS << llvm::format("Time=\"%.9f\" Memory=\"%d\">\n",
-                           EndEntry.TimeStamp - BegEntry.TimeStamp,
-                           EndEntry.MemoryUsage - BegEntry.MemoryUsage);
+  for (; !Tree.open_set.empty(); Tree.open_set.pop_back())
+    OutputOS << "</Entry>\n";
+  Tree.size = 0;
+}
 
-  // Print only first part (heading).
+TemplightStreamingXMLWriter::TemplightStreamingXMLWriter(llvm::raw_ostream &aOS)
+    : TemplightTreeWriter(aOS) {
+  OutputOS << "<?xml version=\"1.0\" standalone=\"yes\"?>\n";
 }
 
-void TemplightNestedXMLWriter::closePrintedTreeNode(
+TemplightStreamingXMLWriter::~TemplightStreamingXMLWriter() {}
+
+void TemplightStreamingXMLWriter::initializeTree(
+    const std::string &aSourceName) {
+  OutputOS << "<Trace>\n";
+}
+
+void TemplightStreamingXMLWriter::finalizeTree() { OutputOS << "</Trace>\n"; }
+
+void TemplightStreamingXMLWriter::openPrintedTreeNode(
+    const EntryTraversalTask &aNode) {
+  printXmlEntryHeading(OutputOS, aNode.start);
+  OutputOS << ">\n";
+
+  // Print only first part (heading), the cost is only known at the end.
+}
+
+void TemplightStreamingXMLWriter::closePrintedTreeNode(
     const EntryTraversalTask &aNode) {
+  const PrintableTemplightEntryBegin &BegEntry = aNode.start;
+  const PrintableTemplightEntryEnd &EndEntry = aNode.finish;
+
+  OutputOS << llvm::format("<Cost Time=\"%.9f\" Memory=\"%d\"/>\n",
+                           EndEntry.TimeStamp - BegEntry.TimeStamp,
+                           EndEntry.MemoryUsage - BegEntry.MemoryUsage);
   OutputOS << "</Entry>\n";
 }
 
@@ -395,7 +555,12 @@ void TemplightGraphMLWriter::initializeTree(const std::string &aSourceName) {
 void TemplightGraphMLWriter::finalizeTree() { OutputOS << "</graph>\n"; }
 
 void TemplightGraphMLWriter::openPrintedTreeNode(
+    const EntryTraversalTask &aNode) {}
+
+void TemplightGraphMLWriter::closePrintedTreeNode(
     const EntryTraversalTask &aNode) {
+  // The nodes are printed once they end (i.e., children first), and the
+  // edge to the parent is printed along with the child.
   const PrintableTemplightEntryBegin &BegEntry = aNode.start;
   const PrintableTemplightEntryEnd &EndEntry = aNode.finish;
 
@@ -419,16 +584,13 @@ void TemplightGraphMLWriter::openPrintedTreeNode(
   }
 
   OutputOS << "</node>\n";
-  if (aNode.parent_id == RecordedDFSEntryTree::invalid_id)
+  if (aNode.parent_id == EntryTraversalTask::invalid_id)
     return;
 
   OutputOS << llvm::format("<edge id=\"e%d\" source=\"n%d\" target=\"n%d\"/>\n",
                            last_edge_id++, aNode.parent_id, aNode.nd_id);
 }
 
-void TemplightGraphMLWriter::closePrintedTreeNode(
-    const EntryTraversalTask &aNode) {}
-
 TemplightGraphVizWriter::TemplightGraphVizWriter(llvm::raw_ostream &aOS)
     : TemplightTreeWriter(aOS) {}
 
@@ -441,7 +603,12 @@ void TemplightGraphVizWriter::initializeTree(const std::string &aSourceName) {
 void TemplightGraphVizWriter::finalizeTree() { OutputOS << "}\n"; }
 
 void TemplightGraphVizWriter::openPrintedTreeNode(
+    const EntryTraversalTask &aNode) {}
+
+void TemplightGraphVizWriter::closePrintedTreeNode(
     const EntryTraversalTask &aNode) {
+  // The nodes are printed once they end (i.e., children first), and the
+  // edge from the parent is printed along with the child.
   const PrintableTemplightEntryBegin &BegEntry = aNode.start;
   const PrintableTemplightEntryEnd &EndEntry = aNode.finish;
 
@@ -462,13 +629,491 @@ void TemplightGraphVizWriter::openPrintedTreeNode(
                            EndEntry.TimeStamp - BegEntry.TimeStamp,
                            EndEntry.MemoryUsage - BegEntry.MemoryUsage);
 
-  if (aNode.parent_id == RecordedDFSEntryTree::invalid_id)
+  if (aNode.parent_id == EntryTraversalTask::invalid_id)
     return;
 
   OutputOS << llvm::format("n%d -> n%d;\n", aNode.parent_id, aNode.nd_id);
 }
 
-void TemplightGraphVizWriter::closePrintedTreeNode(
-    const EntryTraversalTask &aNode) {}
+TemplightChromeTraceWriter::TemplightChromeTraceWriter(llvm::raw_ostream &aOS)
+    : TemplightWriter(aOS), p_stack(new OpenDFSEntryStack()), traceId(0) {
+  Output.reset(new llvm::json::OStream(OutputOS));
+  Output->objectBegin();
+  Output->attribute("displayTimeUnit", "ms");
+  Output->attributeBegin("traceEvents");
+  Output->arrayBegin();
+}
+
+TemplightChromeTraceWriter::~TemplightChromeTraceWriter() {
+  Output->arrayEnd();
+  Output->attributeEnd();
+  Output->objectEnd();
+  OutputOS << "\n";
+}
+
+void TemplightChromeTraceWriter::initialize(const std::string &aSourceName) {
+  // Each trace is a process, named after its source file.
+  ++traceId;
+  Output->object([&] {
+    Output->attribute("name", "process_name");
+    Output->attribute("ph", "M");
+    Output->attribute("pid", traceId);
+    Output->attribute("tid", 0);
+    Output->attributeObject("args",
+                            [&] { Output->attribute("name", aSourceName); });
+  });
+}
+
+void TemplightChromeTraceWriter::finalize() {
+  // The entries that never ended (e.g., after a fatal error) run to the end.
+  while (p_stack->depth > 0) {
+    PrintableTemplightEntryEnd LastEnd = p_stack->last_end;
+    LastEnd.PrunedChildrenTime = 0.0;
+    printEvent(p_stack->endEntry(LastEnd));
+  }
+}
+
+void TemplightChromeTraceWriter::printEntry(
+    const PrintableTemplightEntryBegin &aEntry) {
+  p_stack->beginEntry(aEntry);
+}
+
+void TemplightChromeTraceWriter::printEntry(
+    const PrintableTemplightEntryEnd &aEntry) {
+  if (p_stack->depth == 0)
+    return; // an end without a begin.
+  printEvent(p_stack->endEntry(aEntry));
+}
+
+// Writes a time in microseconds, to the nanosecond, instead of with all the
+// digits of the double.
+static void attributeMicroseconds(llvm::json::OStream &JOS, llvm::StringRef Key,
+                                  double Seconds) {
+  JOS.attributeBegin(Key);
+  JOS.rawValue([&](llvm::raw_ostream &OS) {
+    OS << llvm::format("%.3f", Seconds * 1e6);
+  });
+  JOS.attributeEnd();
+}
+
+void TemplightChromeTraceWriter::printEvent(const EntryTraversalTask &aNode) {
+  const PrintableTemplightEntryBegin &BegEntry = aNode.start;
+  const PrintableTemplightEntryEnd &EndEntry = aNode.finish;
+  const char *Kind = SynthesisKindStrings[BegEntry.SynthesisKind];
+
+  Output->object([&] {
+    Output->attribute("name", llvm::StringRef(BegEntry.Name));
+    Output->attribute("cat", Kind);
+    Output->attribute("ph", "X");
+    Output->attribute("pid", traceId);
+    Output->attribute("tid", 0);
+    attributeMicroseconds(*Output, "ts", BegEntry.TimeStamp);
+    attributeMicroseconds(*Output, "dur",
+                          EndEntry.TimeStamp - BegEntry.TimeStamp);
+    Output->attributeObject("args", [&] {
+      Output->attribute("kind", Kind);
+      scratch.clear();
+      llvm::raw_string_ostream OS(scratch);
+      OS << BegEntry.FileName << '|' << BegEntry.Line << '|'
+         << BegEntry.Column;
+      OS.flush();
+      Output->attribute("location", llvm::StringRef(scratch));
+      if (!BegEntry.TempOri_FileName.empty()) {
+        scratch.clear();
+        OS << BegEntry.TempOri_FileName << '|' << BegEntry.TempOri_Line << '|'
+           << BegEntry.TempOri_Column;
+        OS.flush();
+        Output->attribute("origin", llvm::StringRef(scratch));
+      }
+      Output->attribute("memory", std::int64_t(EndEntry.MemoryUsage -
+                                               BegEntry.MemoryUsage));
+      if (EndEntry.PrunedChildrenTime > 0.0)
+        attributeMicroseconds(*Output, "pruned_children_dur",
+                              EndEntry.PrunedChildrenTime);
+    });
+  });
+}
+
+struct CallgrindProfile {
+  struct Function {
+    unsigned Kind;
+    unsigned NameId;
+    unsigned FileId;
+    int Line;
+    std::uint64_t Time; // exclusive, in nanoseconds.
+    std::uint64_t Memory;
+  };
+  struct Call {
+    std::uint64_t Count;
+    std::uint64_t Time; // inclusive, in nanoseconds.
+    std::uint64_t Memory;
+  };
+  struct OpenCall {
+    unsigned FunctionId;
+    double TimeStamp;
+    std::uint64_t MemoryUsage;
+    double ChildrenTime;
+    std::int64_t ChildrenMemory;
+  };
+
+  llvm::StringMap<unsigned> nameIds;
+  llvm::StringMap<unsigned> fileIds;
+  std::vector<llvm::StringRef> names; // by id (the keys of the maps above).
+  std::vector<llvm::StringRef> files;
+  std::vector<Function> functions;
+  // The functions by (kind, name id), and the calls by (caller, callee).
+  llvm::DenseMap<std::pair<unsigned, unsigned>, unsigned> functionIds;
+  llvm::DenseMap<std::pair<unsigned, unsigned>, Call> calls;
+  std::vector<OpenCall> openCalls;
+  PrintableTemplightEntryEnd lastEnd; // the latest time and memory seen.
+
+  CallgrindProfile() : lastEnd(){};
+
+  static unsigned intern(llvm::StringMap<unsigned> &Ids,
+                         std::vector<llvm::StringRef> &Keys,
+                         llvm::StringRef Key) {
+    auto Res = Ids.try_emplace(Key, Keys.size());
+    if (Res.second)
+      Keys.push_back(Res.first->getKey());
+    return Res.first->second;
+  };
+
+  static std::uint64_t toNanoseconds(double Seconds) {
+    return (Seconds > 0.0 ? std::uint64_t(std::llround(Seconds * 1e9)) : 0);
+  };
+
+  static std::uint64_t toCost(std::int64_t Bytes) {
+    return (Bytes > 0 ? std::uint64_t(Bytes) : 0);
+  };
+
+  void beginEntry(const PrintableTemplightEntryBegin &aEntry) {
+    unsigned NameId = intern(nameIds, names, aEntry.Name);
+    auto Res = functionIds.try_emplace(
+        std::make_pair(unsigned(aEntry.SynthesisKind), NameId),
+        functions.size());
+    if (Res.second) {
+      // A template is placed at its definition, if known.
+      bool HasOrigin = !aEntry.TempOri_FileName.empty();
+      Function F = {unsigned(aEntry.SynthesisKind), NameId,
+                    intern(fileIds, files,
+                           HasOrigin ? aEntry.TempOri_FileName
+                                     : aEntry.FileName),
+                    HasOrigin ? aEntry.TempOri_Line : aEntry.Line, 0, 0};
+      functions.push_back(F);
+    }
+    openCalls.push_back(
+        {Res.first->second, aEntry.TimeStamp, aEntry.MemoryUsage, 0.0, 0});
+    lastEnd.TimeStamp = aEntry.TimeStamp;
+    lastEnd.MemoryUsage = aEntry.MemoryUsage;
+  };
+
+  void endEntry(const PrintableTemplightEntryEnd &aEntry) {
+    OpenCall Callee = openCalls.back();
+    openCalls.pop_back();
+    lastEnd = aEntry;
+
+    double Time = aEntry.TimeStamp - Callee.TimeStamp;
+    std::int64_t Memory = std::int64_t(aEntry.MemoryUsage - Callee.MemoryUsage);
+    Function &F = functions[Callee.FunctionId];
+    F.Time += toNanoseconds(Time - Callee.ChildrenTime -
+                            aEntry.PrunedChildrenTime);
+    F.Memory += toCost(Memory - Callee.ChildrenMemory);
+    if (openCalls.empty())
+      return;
+
+    OpenCall &Caller = openCalls.back();
+    Caller.ChildrenTime += Time;
+    Caller.ChildrenMemory += Memory;
+    Call &C = calls[std::make_pair(Caller.FunctionId, Callee.FunctionId)];
+    ++C.Count;
+    C.Time += toNanoseconds(Time);
+    C.Memory += toCost(Memory);
+  };
+};
+
+TemplightCallgrindWriter::TemplightCallgrindWriter(llvm::raw_ostream &aOS)
+    : TemplightWriter(aOS), p_profile(new CallgrindProfile()) {}
+
+TemplightCallgrindWriter::~TemplightCallgrindWriter() { writeProfile(); }
+
+void TemplightCallgrindWriter::initialize(const std::string &aSourceName) {}
+
+void TemplightCallgrindWriter::finalize() {
+  // The entries that never ended (e.g., after a fatal error) run to the end.
+  while (!p_profile->openCalls.empty()) {
+    PrintableTemplightEntryEnd LastEnd = p_profile->lastEnd;
+    LastEnd.PrunedChildrenTime = 0.0;
+    p_profile->endEntry(LastEnd);
+  }
+}
+
+void TemplightCallgrindWriter::printEntry(
+    const PrintableTemplightEntryBegin &aEntry) {
+  p_profile->beginEntry(aEntry);
+}
+
+void TemplightCallgrindWriter::printEntry(
+    const PrintableTemplightEntryEnd &aEntry) {
+  if (p_profile->openCalls.empty())
+    return; // an end without a begin.
+  p_profile->endEntry(aEntry);
+}
+
+// Writes a compressed name of the callgrind format: its id in parentheses,
+// followed by the name itself, the first time only.
+static void writeCallgrindName(llvm::raw_ostream &OS, const char *Key,
+                               std::vector<bool> &Written, unsigned Id,
+                               llvm::StringRef Name) {
+  OS << Key << "=(" << (Id + 1) << ")";
+  if (!Written[Id]) {
+    Written[Id] = true;
+    OS << " " << Name;
+  }
+  OS << "\n";
+}
+
+void TemplightCallgrindWriter::writeProfile() {
+  const CallgrindProfile &P = *p_profile;
+
+  // Group the calls by caller.
+  std::vector<std::tuple<unsigned, unsigned, CallgrindProfile::Call>> Calls;
+  Calls.reserve(P.calls.size());
+  for (const auto &C : P.calls)
+    Calls.emplace_back(C.first.first, C.first.second, C.second);
+  std::sort(Calls.begin(), Calls.end(),
+            [](const auto &A, const auto &B) {
+              return std::make_pair(std::get<0>(A), std::get<1>(A)) <
+                     std::make_pair(std::get<0>(B), std::get<1>(B));
+            });
+
+  OutputOS << "# callgrind format\n"
+              "version: 1\n"
+              "creator: templight\n"
+              "positions: line\n"
+              "event: Time : Instantiation Time (ns)\n"
+              "event: Memory : Memory Usage (bytes)\n"
+              "events: Time Memory\n\n";
+
+  std::vector<bool> KindWritten(sizeof(SynthesisKindStrings) /
+                                sizeof(SynthesisKindStrings[0]));
+  std::vector<bool> FileWritten(P.files.size());
+  std::vector<bool> NameWritten(P.names.size());
+  auto it_call = Calls.begin();
+  for (unsigned i = 0; i < P.functions.size(); ++i) {
+    const CallgrindProfile::Function &F = P.functions[i];
+    writeCallgrindName(OutputOS, "ob", KindWritten, F.Kind,
+                       SynthesisKindStrings[F.Kind]);
+    writeCallgrindName(OutputOS, "fl", FileWritten, F.FileId,
+                       P.files[F.FileId]);
+    writeCallgrindName(OutputOS, "fn", NameWritten, F.NameId,
+                       P.names[F.NameId]);
+    OutputOS << F.Line << " " << F.Time << " " << F.Memory << "\n";
+    for (; (it_call != Calls.end()) && (std::get<0>(*it_call) == i);
+         ++it_call) {
+      const CallgrindProfile::Function &Callee =
+          P.functions[std::get<1>(*it_call)];
+      const CallgrindProfile::Call &C = std::get<2>(*it_call);
+      writeCallgrindName(OutputOS, "cob", KindWritten, Callee.Kind,
+                         SynthesisKindStrings[Callee.Kind]);
+      writeCallgrindName(OutputOS, "cfl", FileWritten, Callee.FileId,
+                         P.files[Callee.FileId]);
+      writeCallgrindName(OutputOS, "cfn", NameWritten, Callee.NameId,
+                         P.names[Callee.NameId]);
+      OutputOS << "calls=" << C.Count << " " << Callee.Line << "\n"
+               << F.Line << " " << C.Time << " " << C.Memory << "\n";
+    }
+    OutputOS << "\n";
+  }
+  OutputOS.flush();
+}
+
+// Removes the template arguments from a name (e.g., "std::vector<int>::at"
+// becomes "std::vector::at"), but not the angle brackets of operator names.
+static void getPrimaryTemplateName(llvm::StringRef Name, std::string &Result) {
+  static const char *const AngleOperators[] = {
+      "<=>", "<<=", ">>=", "->*", "<<", ">>", "<=", ">=", "->", "<", ">"};
+  Result.clear();
+  unsigned Depth = 0;
+  for (std::size_t i = 0; i < Name.size(); ++i) {
+    char c = Name[i];
+    if (c == '<') {
+      if (Depth++ == 0) {
+        while (!Result.empty() && Result.back() == ' ')
+          Result.pop_back();
+      }
+    } else if (c == '>' && Depth > 0) {
+      --Depth;
+    } else if (Depth == 0) {
+      Result += c;
+      if (c != 'r' || !llvm::StringRef(Result).ends_with("operator") ||
+          (Result.size() > 8 && (llvm::isAlnum(Result[Result.size() - 9]) ||
+                                 Result[Result.size() - 9] == '_')))
+        continue;
+      llvm::StringRef Rest = Name.substr(i + 1).ltrim(' ');
+      for (const char *Op : AngleOperators) {
+        if (Rest.starts_with(Op)) {
+          Result += Op;
+          i = Rest.data() + std::strlen(Op) - Name.data() - 1;
+          break;
+        }
+      }
+    }
+  }
+}
+
+struct FoldedStackTrie {
+  struct Node {
+    unsigned Frame;
+    unsigned FirstChild;
+    unsigned NextSibling;
+    std::uint64_t Time; // exclusive, in nanoseconds.
+  };
+  struct OpenFrame {
+    unsigned NodeId;
+    double TimeStamp;
+    double ChildrenTime;
+  };
+  static constexpr unsigned NoNode = 0; // the root is never a child.
+
+  unsigned maxDepth;
+  bool primaryNames;
+
+  llvm::StringMap<unsigned> frameIds;
+  std::vector<llvm::StringRef> frames; // by id (the keys of frameIds).
+  // The frames of the dictionary entries of the current trace, by their id.
+  llvm::DenseMap<std::size_t, unsigned> dictionaryFrames;
+  std::vector<Node> nodes; // the root first, and the parents before.
+  llvm::DenseMap<std::pair<unsigned, unsigned>, unsigned> children;
+  std::vector<OpenFrame> openFrames;
+  unsigned hiddenDepth; // the open entries beyond the maximum depth.
+  double lastTime;
+  std::string scratch;
+
+  FoldedStackTrie()
+      : maxDepth(0), primaryNames(false), hiddenDepth(0), lastTime(0.0) {
+    nodes.push_back({0, NoNode, NoNode, 0});
+  };
+
+  unsigned getFrame(const PrintableTemplightEntryBegin &aEntry) {
+    if (aEntry.DictionaryId != ~std::size_t(0)) {
+      auto it = dictionaryFrames.find(aEntry.DictionaryId);
+      if (it != dictionaryFrames.end())
+        return it->second;
+    }
+    llvm::StringRef Name = aEntry.Name;
+    if (primaryNames) {
+      getPrimaryTemplateName(Name, scratch);
+      Name = scratch;
+    }
+    auto Res = frameIds.try_emplace(Name, frames.size());
+    if (Res.second)
+      frames.push_back(Res.first->getKey());
+    if (aEntry.DictionaryId != ~std::size_t(0))
+      dictionaryFrames[aEntry.DictionaryId] = Res.first->second;
+    return Res.first->second;
+  };
+
+  void beginEntry(const PrintableTemplightEntryBegin &aEntry) {
+    lastTime = aEntry.TimeStamp;
+    if (hiddenDepth > 0 || (maxDepth != 0 && openFrames.size() == maxDepth)) {
+      ++hiddenDepth;
+      return;
+    }
+    unsigned Parent = (openFrames.empty() ? 0 : openFrames.back().NodeId);
+    unsigned Frame = getFrame(aEntry);
+    auto Res = children.try_emplace(std::make_pair(Parent, Frame),
+                                    unsigned(nodes.size()));
+    if (Res.second) {
+      nodes.push_back({Frame, NoNode, nodes[Parent].FirstChild, 0});
+      nodes[Parent].FirstChild = Res.first->second;
+    }
+    openFrames.push_back({Res.first->second, aEntry.TimeStamp, 0.0});
+  };
+
+  void endEntry(const PrintableTemplightEntryEnd &aEntry) {
+    lastTime = aEntry.TimeStamp;
+    if (hiddenDepth > 0) {
+      --hiddenDepth;
+      return;
+    }
+    OpenFrame Top = openFrames.back();
+    openFrames.pop_back();
+    double Time = aEntry.TimeStamp - Top.TimeStamp;
+    double SelfTime = Time - Top.ChildrenTime - aEntry.PrunedChildrenTime;
+    if (SelfTime > 0.0)
+      nodes[Top.NodeId].Time += std::uint64_t(std::llround(SelfTime * 1e9));
+    if (!openFrames.empty())
+      openFrames.back().ChildrenTime += Time;
+  };
+};
+
+TemplightFoldedStackWriter::TemplightFoldedStackWriter(llvm::raw_ostream &aOS)
+    : TemplightWriter(aOS), p_trie(new FoldedStackTrie()) {}
+
+TemplightFoldedStackWriter::~TemplightFoldedStackWriter() { writeStacks(); }
+
+void TemplightFoldedStackWriter::setMaxStackDepth(unsigned aMaxDepth) {
+  p_trie->maxDepth = aMaxDepth;
+}
+
+void TemplightFoldedStackWriter::setPrimaryTemplateNames(bool aPrimaryNames) {
+  p_trie->primaryNames = aPrimaryNames;
+  p_trie->dictionaryFrames.clear();
+}
+
+void TemplightFoldedStackWriter::initialize(const std::string &aSourceName) {
+  // The dictionary ids are only unique within a trace.
+  p_trie->dictionaryFrames.clear();
+}
+
+void TemplightFoldedStackWriter::finalize() {
+  // The entries that never ended (e.g., after a fatal error) run to the end.
+  PrintableTemplightEntryEnd LastEnd = {p_trie->lastTime, 0, 0.0};
+  while (p_trie->hiddenDepth > 0 || !p_trie->openFrames.empty())
+    p_trie->endEntry(LastEnd);
+}
+
+void TemplightFoldedStackWriter::printEntry(
+    const PrintableTemplightEntryBegin &aEntry) {
+  p_trie->beginEntry(aEntry);
+}
+
+void TemplightFoldedStackWriter::printEntry(
+    const PrintableTemplightEntryEnd &aEntry) {
+  if (p_trie->hiddenDepth == 0 && p_trie->openFrames.empty())
+    return; // an end without a begin.
+  p_trie->endEntry(aEntry);
+}
+
+void TemplightFoldedStackWriter::writeStacks() {
+  const FoldedStackTrie &T = *p_trie;
+
+  // Depth-first, with the stack of the current node in Stack, and the length
+  // of the stack of each of the pending nodes.
+  std::string Stack;
+  std::vector<std::pair<unsigned, std::size_t>> Pending;
+  for (unsigned c = T.nodes[0].FirstChild; c != T.NoNode;
+       c = T.nodes[c].NextSibling)
+    Pending.emplace_back(c, 0);
+  while (!Pending.empty()) {
+    unsigned n = Pending.back().first;
+    Stack.resize(Pending.back().second);
+    Pending.pop_back();
+
+    const FoldedStackTrie::Node &Nd = T.nodes[n];
+    if (!Stack.empty())
+      Stack += ';';
+    std::size_t FrameBegin = Stack.size();
+    Stack += T.frames[Nd.Frame];
+    // The frames are separated by semicolons, so none can be in a name.
+    std::replace(Stack.begin() + FrameBegin, Stack.end(), ';', ',');
+    if (Nd.Time > 0)
+      OutputOS << Stack << " " << Nd.Time << "\n";
+
+    for (unsigned c = Nd.FirstChild; c != T.NoNode; c = T.nodes[c].NextSibling)
+      Pending.emplace_back(c, Stack.size());
+  }
+  OutputOS.flush();
+}
 
 } // namespace clang
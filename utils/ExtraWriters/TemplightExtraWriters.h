@@ -18,13 +18,16 @@
 #include <string>
 
 namespace llvm {
-namespace yaml {
-class Output;
+namespace json {
+class OStream;
 }
 } // namespace llvm
 
 namespace clang {
 
+/// \brief Writes the entries as a YAML sequence of mappings, which is
+/// emitted directly (with the same layout and quoting as llvm::yaml::Output)
+/// instead of going through the YAML I/O traits for every entry.
 class TemplightYamlWriter : public TemplightWriter {
 public:
   TemplightYamlWriter(llvm::raw_ostream &aOS);
@@ -37,7 +40,7 @@ public:
   void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
 
 private:
-  std::unique_ptr<llvm::yaml::Output> Output;
+  bool emptySequence;
 };
 
 class TemplightXmlWriter : public TemplightWriter {
@@ -50,6 +53,7 @@ public:
 
   void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
   void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+  void printSummary(const PrintableTemplightSummaryEntry &aEntry) override;
 };
 
 class TemplightTextWriter : public TemplightWriter {
@@ -62,11 +66,17 @@ public:
 
   void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
   void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+  void printSummary(const PrintableTemplightSummaryEntry &aEntry) override;
 };
 
-struct RecordedDFSEntryTree;
+struct OpenDFSEntryStack;
 struct EntryTraversalTask;
 
+/// \brief The base of the writers that print the instantiations as a tree.
+/// The tree is not recorded, the nodes are printed as the entries come, and
+/// only the stack of open nodes is kept (whose slots are reused, along with
+/// the capacity of their strings), such that the memory usage only depends
+/// on the depth of the trace, not on its size.
 class TemplightTreeWriter : public TemplightWriter {
 public:
   TemplightTreeWriter(llvm::raw_ostream &aOS);
@@ -79,20 +89,48 @@ public:
   void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
 
 protected:
+  /// \brief Called at the begin entry of a node, before its children (the
+  /// end of the node is not known yet).
   virtual void openPrintedTreeNode(const EntryTraversalTask &aNode) = 0;
+  /// \brief Called at the end entry of a node, after its children.
   virtual void closePrintedTreeNode(const EntryTraversalTask &aNode) = 0;
 
   virtual void initializeTree(const std::string &aSourceName) = 0;
   virtual void finalizeTree() = 0;
 
-  std::unique_ptr<RecordedDFSEntryTree> p_tree;
+  std::unique_ptr<OpenDFSEntryStack> p_stack;
 };
 
+struct BufferedDFSEntryTree;
+
+/// \brief Writes the instantiations as nested <Entry> elements, with their
+/// Time and Memory as attributes. Since these are only known at the end of
+/// an element, each top-level tree is kept until it ends, and then written
+/// out (see TemplightStreamingXMLWriter for a one-pass alternative).
 class TemplightNestedXMLWriter : public TemplightTreeWriter {
 public:
   TemplightNestedXMLWriter(llvm::raw_ostream &aOS);
   ~TemplightNestedXMLWriter();
 
+protected:
+  void openPrintedTreeNode(const EntryTraversalTask &aNode) override;
+  void closePrintedTreeNode(const EntryTraversalTask &aNode) override;
+
+  void initializeTree(const std::string &aSourceName = "") override;
+  void finalizeTree() override;
+
+private:
+  std::unique_ptr<BufferedDFSEntryTree> p_tree;
+};
+
+/// \brief Writes the instantiations as nested <Entry> elements, like the
+/// TemplightNestedXMLWriter, but as the entries come: the Time and Memory of
+/// an element are the attributes of a <Cost/> element, its last child.
+class TemplightStreamingXMLWriter : public TemplightTreeWriter {
+public:
+  TemplightStreamingXMLWriter(llvm::raw_ostream &aOS);
+  ~TemplightStreamingXMLWriter();
+
 protected:
   void openPrintedTreeNode(const EntryTraversalTask &aNode) override;
   void closePrintedTreeNode(const EntryTraversalTask &aNode) override;
@@ -130,6 +168,91 @@ protected:
   void finalizeTree() override;
 };
 
+/// \brief Writes the instantiations as complete ("X") events of the Chrome
+/// trace-event format (for chrome://tracing or Perfetto), with one process
+/// per trace. An event is written at the end entry of its instantiation,
+/// from the stack of open entries, so the trace is converted in one pass,
+/// with a memory usage that only depends on its depth.
+class TemplightChromeTraceWriter : public TemplightWriter {
+public:
+  TemplightChromeTraceWriter(llvm::raw_ostream &aOS);
+  ~TemplightChromeTraceWriter();
+
+  void initialize(const std::string &aSourceName = "") override;
+  void finalize() override;
+
+  void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
+  void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+
+private:
+  void printEvent(const EntryTraversalTask &aNode);
+
+  std::unique_ptr<llvm::json::OStream> Output;
+  std::unique_ptr<OpenDFSEntryStack> p_stack;
+  std::string scratch;
+  unsigned traceId;
+};
+
+struct CallgrindProfile;
+
+/// \brief Writes the profile in the callgrind format (for KCacheGrind), in
+/// which each template (by kind and name) is a function, with its exclusive
+/// time (in nanoseconds) and memory as its own cost, and the instantiations
+/// it triggered as calls, aggregated by caller and callee. The profile is
+/// aggregated in one pass over the entries (of all the traces given to the
+/// writer), and written out when the writer is destroyed.
+class TemplightCallgrindWriter : public TemplightWriter {
+public:
+  TemplightCallgrindWriter(llvm::raw_ostream &aOS);
+  ~TemplightCallgrindWriter();
+
+  void initialize(const std::string &aSourceName = "") override;
+  void finalize() override;
+
+  void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
+  void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+
+private:
+  void writeProfile();
+
+  std::unique_ptr<CallgrindProfile> p_profile;
+};
+
+struct FoldedStackTrie;
+
+/// \brief Writes the collapsed stacks of the instantiations (i.e., lines of
+/// "a;b;c <time>", for flamegraph.pl and the like), with the exclusive time of
+/// each stack in nanoseconds. The identical stacks are aggregated in a trie
+/// (of all the traces given to the writer), whose frames are looked up by the
+/// dictionary ids of the names when the entries have them, and the stacks
+/// are written out when the writer is destroyed.
+class TemplightFoldedStackWriter : public TemplightWriter {
+public:
+  TemplightFoldedStackWriter(llvm::raw_ostream &aOS);
+  ~TemplightFoldedStackWriter();
+
+  /// \brief Sets the maximum depth of the stacks (or zero, the default, for
+  /// no limit). The time of the deeper instantiations is given to their
+  /// ancestor at that depth.
+  void setMaxStackDepth(unsigned aMaxDepth);
+
+  /// \brief Sets whether the frames are the primary templates (e.g.,
+  /// "std::vector::push_back"), such that all their specializations are
+  /// collapsed together, instead of the full names (the default).
+  void setPrimaryTemplateNames(bool aPrimaryNames);
+
+  void initialize(const std::string &aSourceName = "") override;
+  void finalize() override;
+
+  void printEntry(const PrintableTemplightEntryBegin &aEntry) override;
+  void printEntry(const PrintableTemplightEntryEnd &aEntry) override;
+
+private:
+  void writeStacks();
+
+  std::unique_ptr<FoldedStackTrie> p_trie;
+};
+
 /*
 class ProtobufPrinter : public TemplightTracer::TracePrinter {
 protected:
@@ -0,0 +1,92 @@
+//===- TemplightMappedTraceReader.cpp --------*- C++ -*--------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "TemplightMappedTraceReader.h"
+
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/raw_ostream.h>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/mman.h>
+#endif
+
+#include <cstdint>
+#include <string>
+
+namespace clang {
+
+TemplightMappedTraceReader::TemplightMappedTraceReader(
+    std::size_t aReleaseSize)
+    : releasedEnd(nullptr), releaseSize(aReleaseSize) {}
+
+TemplightProtobufReader::LastChunkType
+TemplightMappedTraceReader::open(const std::string &aFileName) {
+  region.reset();
+  releasedEnd = nullptr;
+  Reader.LastChunk = TemplightProtobufReader::EndOfFile;
+
+  llvm::Expected<llvm::sys::fs::file_t> FD =
+      llvm::sys::fs::openNativeFileForRead(aFileName);
+  if (!FD) {
+    llvm::errs() << "Error: [Templight-Reader] Cannot open the trace file: "
+                 << aFileName << " Error: " << llvm::toString(FD.takeError())
+                 << "\n";
+    return Reader.LastChunk;
+  }
+  llvm::sys::fs::file_status Status;
+  std::error_code EC = llvm::sys::fs::status(*FD, Status);
+  std::uint64_t Size = Status.getSize();
+  if (!EC && (Size > 0))
+    region = std::make_unique<llvm::sys::fs::mapped_file_region>(
+        *FD, llvm::sys::fs::mapped_file_region::readonly, Size, 0, EC);
+  llvm::sys::fs::closeFile(*FD);
+  if (EC) {
+    region.reset();
+    llvm::errs() << "Error: [Templight-Reader] Cannot map the trace file: "
+                 << aFileName << " Error: " << EC.message() << "\n";
+    return Reader.LastChunk;
+  }
+  if (!region)
+    return Reader.LastChunk; // an empty file.
+
+  releasedEnd = region->const_data();
+  Reader.startOnBuffer(llvm::StringRef(region->const_data(), Size));
+  return Reader.LastChunk;
+}
+
+void TemplightMappedTraceReader::releaseReadPages() {
+#ifdef LLVM_ON_UNIX
+  const char *Pos = Reader.getInputPosition();
+  if (!Pos)
+    return;
+  // Only release whole pages, from the start of the mapping (page-aligned).
+  const std::size_t PageSize = llvm::sys::fs::mapped_file_region::alignment();
+  std::size_t ReadSize = Pos - region->const_data();
+  const char *End = region->const_data() + ReadSize / PageSize * PageSize;
+  if (std::size_t(End - releasedEnd) < releaseSize)
+    return;
+  // NOTE: The pages of the file are read again, if they are touched again.
+  ::madvise(const_cast<char *>(releasedEnd), End - releasedEnd,
+            MADV_DONTNEED);
+  releasedEnd = End;
+#endif
+}
+
+TemplightProtobufReader::LastChunkType TemplightMappedTraceReader::next() {
+  if (Reader.next() == TemplightProtobufReader::EndOfFile) {
+    region.reset();
+    releasedEnd = nullptr;
+    return Reader.LastChunk;
+  }
+  releaseReadPages();
+  return Reader.LastChunk;
+}
+
+} // namespace clang
@@ -0,0 +1,49 @@
+//===- TemplightMappedTraceReader.h -----------------*- C++ -*-------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CLANG_TEMPLIGHT_MAPPED_TRACE_READER_H
+#define LLVM_CLANG_TEMPLIGHT_MAPPED_TRACE_READER_H
+
+#include "TemplightProtobufReader.h"
+
+#include <llvm/Support/FileSystem.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace clang {
+
+/// \brief Reads a trace file by mapping it in memory instead of loading it,
+/// and releases the pages that were read every \p aReleaseSize bytes, such
+/// that the memory used does not grow with the size of the file (only with
+/// the size of its dictionaries and of its largest compressed chunk).
+class TemplightMappedTraceReader {
+private:
+  std::unique_ptr<llvm::sys::fs::mapped_file_region> region;
+  const char *releasedEnd; // the pages before this were released.
+  std::size_t releaseSize;
+
+  void releaseReadPages();
+
+public:
+  TemplightProtobufReader Reader;
+
+  TemplightMappedTraceReader(std::size_t aReleaseSize = 64 << 20);
+
+  /// \brief Maps the file and starts reading it, or returns EndOfFile (after
+  /// printing an error) if it cannot be mapped.
+  TemplightProtobufReader::LastChunkType open(const std::string &aFileName);
+
+  TemplightProtobufReader::LastChunkType next();
+};
+
+} // namespace clang
+
+#endif
@@ -9,21 +9,36 @@
 
 #include "TemplightProtobufReader.h"
 
+#include "TemplightProtobufWriter.h"
 #include "ThinProtobuf.h"
 
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/CRC.h>
 #include <llvm/Support/Compression.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <numeric>
 #include <string>
 
 namespace clang {
 
-TemplightProtobufReader::TemplightProtobufReader() {}
+TemplightProtobufReader::TemplightProtobufReader()
+    : nameSaver(nameArena), copyNames(true), lazyNames(false),
+      memoizeNames(true), readingCompressedTrace(false), lastTimeStamp(0),
+      lastMemoryUsage(0), loadedChunks(0), decompressedChunk(~0u),
+      LastChunk(EndOfFile), entryDepth(0), skipDepth(0), recoveryMode(false),
+      truncationReported(false) {}
 
 void TemplightProtobufReader::loadHeader(llvm::StringRef aSubBuffer) {
   // Set default values:
   Version = 0;
   SourceName = "";
+  Chunk = 0;
 
   while (aSubBuffer.size()) {
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
@@ -34,28 +49,48 @@ void TemplightProtobufReader::loadHeader(llvm::StringRef aSubBuffer) {
     case llvm::protobuf::getStringWire<2>::value:
       SourceName = llvm::protobuf::loadString(aSubBuffer);
       break;
+    case llvm::protobuf::getVarIntWire<3>::value:
+      Chunk = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
     default:
       llvm::protobuf::skipData(aSubBuffer, cur_wire);
       break;
     }
   }
 
+  // Only a new trace starts new dictionaries, continuation chunks refer to
+  // the files and names of the previous chunks.
+  if (Chunk == 0) {
+    fileNameMap.clear();
+    dictionaryEntries.clear();
+    dictionaryMarkers.clear();
+    expandedNames.clear();
+    entryDepth = 0;
+    skipDepth = 0;
+    OpenEntries.clear();
+    truncationReported = false;
+  }
+  // But the deltas start over in each chunk.
+  lastTimeStamp = 0;
+  lastMemoryUsage = 0;
+
   LastChunk = TemplightProtobufReader::Header;
 }
 
 void TemplightProtobufReader::loadDictionaryEntry(llvm::StringRef aSubBuffer) {
   // Set default values:
-  std::string name = "";
-  llvm::SmallVector<std::size_t, 8> markers;
+  DictionaryEntry Entry = {llvm::StringRef(), dictionaryMarkers.size(), 0};
 
   while (aSubBuffer.size()) {
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
     switch (cur_wire) {
     case llvm::protobuf::getStringWire<1>::value:
-      name = llvm::protobuf::loadString(aSubBuffer);
+      Entry.MarkedName =
+          nameSaver.save(llvm::protobuf::loadStringRef(aSubBuffer));
       break;
     case llvm::protobuf::getVarIntWire<2>::value:
-      markers.push_back(llvm::protobuf::loadVarInt(aSubBuffer));
+      dictionaryMarkers.push_back(llvm::protobuf::loadVarInt(aSubBuffer));
+      ++Entry.NumMarkers;
       break;
     default:
       llvm::protobuf::skipData(aSubBuffer, cur_wire);
@@ -63,24 +98,53 @@ void TemplightProtobufReader::loadDictionaryEntry(llvm::StringRef aSubBuffer) {
     }
   }
 
-  std::string::iterator it_name = std::find(name.begin(), name.end(), '\0');
-  llvm::SmallVector<std::size_t, 8>::iterator it_mark = markers.begin();
-  while ((it_name != name.end()) && (it_mark != markers.end())) {
-    std::size_t offset = it_name - name.begin();
-    name.replace(it_name, it_name + 1, templateNameMap[*it_mark]);
-    it_name = std::find(name.begin() + offset, name.end(), '\0');
-    ++it_mark;
+  dictionaryEntries.push_back(Entry);
+  expandedNames.emplace_back();
+}
+
+void TemplightProtobufReader::expandName(std::size_t NameId,
+                                         llvm::SmallVectorImpl<char> &Name) {
+  if (NameId >= dictionaryEntries.size())
+    return;
+  if (expandedNames[NameId].data()) {
+    Name.append(expandedNames[NameId].begin(), expandedNames[NameId].end());
+    return;
+  }
+  // NOTE: The markers always refer to earlier entries, so this terminates.
+  const DictionaryEntry &Entry = dictionaryEntries[NameId];
+  std::size_t it_mark = Entry.FirstMarker;
+  std::size_t end_mark = Entry.FirstMarker + Entry.NumMarkers;
+  for (char c : Entry.MarkedName) {
+    if ((c != '\0') || (it_mark == end_mark)) {
+      Name.push_back(c);
+      continue;
+    }
+    std::size_t MarkerId = dictionaryMarkers[it_mark++];
+    if (MarkerId < NameId)
+      expandName(MarkerId, Name);
   }
+}
 
-  templateNameMap.push_back(name);
+llvm::StringRef TemplightProtobufReader::getName(std::size_t NameId) {
+  if (NameId >= dictionaryEntries.size())
+    return llvm::StringRef();
+  if (expandedNames[NameId].data())
+    return expandedNames[NameId];
+  nameScratch.clear();
+  expandName(NameId, nameScratch);
+  if (!memoizeNames)
+    return nameScratch.str();
+  expandedNames[NameId] = nameSaver.save(nameScratch.str());
+  return expandedNames[NameId];
 }
 
-static void loadLocation(llvm::StringRef aSubBuffer,
-                         std::vector<std::string> &fileNameMap,
-                         std::string &FileName, int &Line, int &Column) {
+void TemplightProtobufReader::loadLocation(llvm::StringRef aSubBuffer,
+                                           llvm::StringRef &FileName,
+                                           std::size_t &FileID, int &Line,
+                                           int &Column) {
   // Set default values:
-  FileName = "";
-  std::size_t FileID = std::numeric_limits<std::size_t>::max();
+  FileName = llvm::StringRef();
+  FileID = BeginEntryRef::NoId;
   Line = 0;
   Column = 0;
 
@@ -88,7 +152,7 @@ static void loadLocation(llvm::StringRef aSubBuffer,
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
     switch (cur_wire) {
     case llvm::protobuf::getStringWire<1>::value:
-      FileName = llvm::protobuf::loadString(aSubBuffer);
+      FileName = llvm::protobuf::loadStringRef(aSubBuffer);
       break;
     case llvm::protobuf::getVarIntWire<2>::value:
       FileID = llvm::protobuf::loadVarInt(aSubBuffer);
@@ -105,10 +169,11 @@ static void loadLocation(llvm::StringRef aSubBuffer,
     }
   }
 
-  if (FileID != std::numeric_limits<std::size_t>::max()) {
+  if (FileID != BeginEntryRef::NoId) {
     if (fileNameMap.size() <= FileID)
       fileNameMap.resize(FileID + 1);
     if (!FileName.empty()) {
+      FileName = nameSaver.save(FileName);
       fileNameMap[FileID] =
           FileName; // overwrite existing names, if any, but there shouldn't be.
     } else {
@@ -117,30 +182,34 @@ static void loadLocation(llvm::StringRef aSubBuffer,
   } // else we don't care?
 }
 
-void TemplightProtobufReader::loadTemplateName(llvm::StringRef aSubBuffer) {
+void TemplightProtobufReader::loadTemplateName(llvm::StringRef aSubBuffer,
+                                               llvm::StringRef &Name,
+                                               std::size_t &NameId) {
   // Set default values:
-  LastBeginEntry.Name = "";
+  Name = llvm::StringRef();
+  NameId = BeginEntryRef::NoId;
 
   while (aSubBuffer.size()) {
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
     switch (cur_wire) {
     case llvm::protobuf::getStringWire<1>::value:
-      LastBeginEntry.Name = llvm::protobuf::loadString(aSubBuffer);
+      Name = llvm::protobuf::loadStringRef(aSubBuffer);
       break;
     case llvm::protobuf::getStringWire<2>::value: {
-      LastBeginEntry.Name = llvm::protobuf::loadString(aSubBuffer);
-      llvm::SmallVector<char, 32> UBuf;
-      if (llvm::zlib::uncompress(LastBeginEntry.Name, UBuf,
-                                 LastBeginEntry.Name.size() * 2) ==
-          llvm::zlib::StatusOK)
-        LastBeginEntry.Name.assign(UBuf.begin(), UBuf.end());
-      else
-        LastBeginEntry.Name = "";
+      llvm::StringRef Compressed = llvm::protobuf::loadStringRef(aSubBuffer);
+      decompressedName.clear();
+      if (llvm::Error Err = llvm::compression::zlib::decompress(
+              llvm::arrayRefFromStringRef(Compressed), decompressedName,
+              Compressed.size() * 2)) {
+        llvm::consumeError(std::move(Err));
+        Name = llvm::StringRef();
+      } else {
+        Name = llvm::toStringRef(decompressedName);
+      }
       break;
     }
     case llvm::protobuf::getVarIntWire<3>::value: {
-      LastBeginEntry.Name =
-          templateNameMap[llvm::protobuf::loadVarInt(aSubBuffer)];
+      NameId = llvm::protobuf::loadVarInt(aSubBuffer);
       break;
     }
     default:
@@ -150,12 +219,33 @@ void TemplightProtobufReader::loadTemplateName(llvm::StringRef aSubBuffer) {
   }
 }
 
-void TemplightProtobufReader::loadBeginEntry(llvm::StringRef aSubBuffer) {
+void TemplightProtobufReader::applyEntryDeltas(std::int64_t TimeDelta,
+                                               std::int64_t MemoryDelta,
+                                               double &TimeStamp,
+                                               std::uint64_t &MemoryUsage) {
+  lastTimeStamp += TimeDelta;
+  lastMemoryUsage += MemoryDelta;
+  TimeStamp = double(lastTimeStamp) * 1e-9;
+  MemoryUsage = lastMemoryUsage;
+}
+
+bool TemplightProtobufReader::loadBeginEntry(llvm::StringRef aSubBuffer) {
   // Set default values:
   LastBeginEntry.SynthesisKind = 0;
-  LastBeginEntry.Name = "";
+  LastBeginEntry.Line = 0;
+  LastBeginEntry.Column = 0;
   LastBeginEntry.TimeStamp = 0.0;
   LastBeginEntry.MemoryUsage = 0;
+  LastBeginEntry.TempOri_Line = 0;
+  LastBeginEntry.TempOri_Column = 0;
+  LastBeginRef.Name = llvm::StringRef();
+  LastBeginRef.NameId = BeginEntryRef::NoId;
+  LastBeginRef.FileName = llvm::StringRef();
+  LastBeginRef.FileId = BeginEntryRef::NoId;
+  LastBeginRef.TempOri_FileName = llvm::StringRef();
+  LastBeginRef.TempOri_FileId = BeginEntryRef::NoId;
+  std::int64_t TimeDelta = 0;
+  std::int64_t MemoryDelta = 0;
 
   while (aSubBuffer.size()) {
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
@@ -165,14 +255,15 @@ void TemplightProtobufReader::loadBeginEntry(llvm::StringRef aSubBuffer) {
       break;
     case llvm::protobuf::getStringWire<2>::value: {
       std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
-      loadTemplateName(aSubBuffer.slice(0, cur_size));
+      loadTemplateName(aSubBuffer.slice(0, cur_size), LastBeginRef.Name,
+                       LastBeginRef.NameId);
       aSubBuffer = aSubBuffer.drop_front(cur_size);
       break;
     }
     case llvm::protobuf::getStringWire<3>::value: {
       std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
-      loadLocation(aSubBuffer.slice(0, cur_size), fileNameMap,
-                   LastBeginEntry.FileName, LastBeginEntry.Line,
+      loadLocation(aSubBuffer.slice(0, cur_size), LastBeginRef.FileName,
+                   LastBeginRef.FileId, LastBeginEntry.Line,
                    LastBeginEntry.Column);
       aSubBuffer = aSubBuffer.drop_front(cur_size);
       break;
@@ -185,25 +276,62 @@ void TemplightProtobufReader::loadBeginEntry(llvm::StringRef aSubBuffer) {
       break;
     case llvm::protobuf::getStringWire<6>::value: {
       std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
-      loadLocation(aSubBuffer.slice(0, cur_size), fileNameMap,
-                   LastBeginEntry.TempOri_FileName, LastBeginEntry.TempOri_Line,
-                   LastBeginEntry.TempOri_Column);
+      loadLocation(aSubBuffer.slice(0, cur_size),
+                   LastBeginRef.TempOri_FileName, LastBeginRef.TempOri_FileId,
+                   LastBeginEntry.TempOri_Line, LastBeginEntry.TempOri_Column);
       aSubBuffer = aSubBuffer.drop_front(cur_size);
       break;
     }
+    case llvm::protobuf::getSIntWire<7>::value:
+      TimeDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<8>::value:
+      MemoryDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
     default:
       llvm::protobuf::skipData(aSubBuffer, cur_wire);
       break;
     }
   }
 
+  if (Version >= 2)
+    applyEntryDeltas(TimeDelta, MemoryDelta, LastBeginEntry.TimeStamp,
+                     LastBeginEntry.MemoryUsage);
+
+  if (entryFilter) {
+    EntryFilterInfo Info = {LastBeginEntry.SynthesisKind, LastBeginRef.NameId,
+                            LastBeginRef.FileId, entryDepth};
+    if (!entryFilter(Info))
+      return false;
+  }
+  ++entryDepth;
+
+  if ((LastBeginRef.NameId != BeginEntryRef::NoId) && !lazyNames)
+    LastBeginRef.Name = getName(LastBeginRef.NameId);
+
+  // NOTE: The strings keep their capacity from one entry to the next, so
+  // copying the names does not allocate memory, most of the time.
+  if (copyNames) {
+    LastBeginEntry.Name.assign(LastBeginRef.Name.data(),
+                               LastBeginRef.Name.size());
+    LastBeginEntry.FileName.assign(LastBeginRef.FileName.data(),
+                                   LastBeginRef.FileName.size());
+    LastBeginEntry.TempOri_FileName.assign(
+        LastBeginRef.TempOri_FileName.data(),
+        LastBeginRef.TempOri_FileName.size());
+  }
+
   LastChunk = TemplightProtobufReader::BeginEntry;
+  return true;
 }
 
 void TemplightProtobufReader::loadEndEntry(llvm::StringRef aSubBuffer) {
   // Set default values:
   LastEndEntry.TimeStamp = 0.0;
   LastEndEntry.MemoryUsage = 0;
+  LastEndEntry.PrunedChildrenTime = 0.0;
+  std::int64_t TimeDelta = 0;
+  std::int64_t MemoryDelta = 0;
 
   while (aSubBuffer.size()) {
     unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
@@ -214,79 +342,765 @@ void TemplightProtobufReader::loadEndEntry(llvm::StringRef aSubBuffer) {
     case llvm::protobuf::getVarIntWire<2>::value:
       LastEndEntry.MemoryUsage = llvm::protobuf::loadVarInt(aSubBuffer);
       break;
+    case llvm::protobuf::getDoubleWire<3>::value:
+      LastEndEntry.PrunedChildrenTime = llvm::protobuf::loadDouble(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<4>::value:
+      TimeDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<5>::value:
+      MemoryDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
     default:
       llvm::protobuf::skipData(aSubBuffer, cur_wire);
       break;
     }
   }
 
+  if (Version >= 2)
+    applyEntryDeltas(TimeDelta, MemoryDelta, LastEndEntry.TimeStamp,
+                     LastEndEntry.MemoryUsage);
+  if (entryDepth > 0)
+    --entryDepth;
+
   LastChunk = TemplightProtobufReader::EndEntry;
 }
 
-TemplightProtobufReader::LastChunkType
-TemplightProtobufReader::startOnBuffer(llvm::StringRef aBuffer) {
-  buffer = aBuffer;
-  fileNameMap.clear();
-  unsigned int cur_wire = llvm::protobuf::loadVarInt(buffer);
-  if (cur_wire != llvm::protobuf::getStringWire<1>::value) {
-    buffer = llvm::StringRef();
-    remainder_buffer = llvm::StringRef();
-    LastChunk = TemplightProtobufReader::EndOfFile;
-    return LastChunk;
+void TemplightProtobufReader::skipBeginEntry(llvm::StringRef aSubBuffer) {
+  std::int64_t TimeDelta = 0;
+  std::int64_t MemoryDelta = 0;
+
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getStringWire<3>::value:
+    case llvm::protobuf::getStringWire<6>::value: {
+      // Only the locations that give a new file name (first) are read.
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
+      llvm::StringRef loc_buffer = aSubBuffer.slice(0, cur_size);
+      aSubBuffer = aSubBuffer.drop_front(cur_size);
+      llvm::StringRef peek_buffer = loc_buffer;
+      if (llvm::protobuf::loadVarInt(peek_buffer) ==
+          llvm::protobuf::getStringWire<1>::value) {
+        llvm::StringRef FileName;
+        std::size_t FileId;
+        int Line, Column;
+        loadLocation(loc_buffer, FileName, FileId, Line, Column);
+      }
+      break;
+    }
+    case llvm::protobuf::getSIntWire<7>::value:
+      TimeDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<8>::value:
+      MemoryDelta = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
+    }
+  }
+
+  if (Version >= 2) {
+    lastTimeStamp += TimeDelta;
+    lastMemoryUsage += MemoryDelta;
   }
-  std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
-  remainder_buffer = buffer.slice(cur_size, buffer.size());
-  buffer = buffer.slice(0, cur_size);
-  return next();
 }
 
-TemplightProtobufReader::LastChunkType TemplightProtobufReader::next() {
-  if (buffer.empty()) {
-    if (remainder_buffer.empty()) {
-      LastChunk = TemplightProtobufReader::EndOfFile;
-      return LastChunk;
-    } else {
-      return startOnBuffer(remainder_buffer);
+void TemplightProtobufReader::skipEndEntry(llvm::StringRef aSubBuffer) {
+  if (Version < 2)
+    return; // nothing in it matters to the next entries.
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getSIntWire<4>::value:
+      lastTimeStamp += llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<5>::value:
+      lastMemoryUsage += llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
     }
   }
-  unsigned int cur_wire = llvm::protobuf::loadVarInt(buffer);
-  switch (cur_wire) {
-  case llvm::protobuf::getStringWire<1>::value: {
-    std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
-    loadHeader(buffer.slice(0, cur_size));
-    buffer = buffer.drop_front(cur_size);
-    return LastChunk;
-  };
-  case llvm::protobuf::getStringWire<2>::value: {
+}
+
+// Gets the chunk number of a trace (field 1), compressed trace (field 2) or
+// frame (field 6) of a collection, from its header, or from the compressed
+// trace itself.
+static unsigned int getTraceChunk(unsigned int aWire,
+                                  llvm::StringRef aSubBuffer) {
+  unsigned int chunk_wire = llvm::protobuf::getVarIntWire<4>::value;
+  if ((aWire == llvm::protobuf::getStringWire<1>::value) ||
+      (aWire == llvm::protobuf::getStringWire<6>::value)) {
+    if (llvm::protobuf::loadVarInt(aSubBuffer) !=
+        llvm::protobuf::getStringWire<1>::value)
+      return 0;
+    aSubBuffer = aSubBuffer.slice(0, llvm::protobuf::loadVarInt(aSubBuffer));
+    chunk_wire = llvm::protobuf::getVarIntWire<3>::value;
+  }
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    if (cur_wire == chunk_wire)
+      return llvm::protobuf::loadVarInt(aSubBuffer);
+    llvm::protobuf::skipData(aSubBuffer, cur_wire);
+  }
+  return 0;
+}
+
+// Checks if a collection continues with the newline that the driver appends
+// to each file it merges. That newline reads as the key of a trace (field 1),
+// with the key of the next field as its length, so it is only taken for a
+// trace if that gives one that starts with its header.
+static bool isTraceSeparator(llvm::StringRef aBuffer) {
+  if (aBuffer.empty() || (aBuffer.front() != '\n'))
+    return false;
+  aBuffer = aBuffer.drop_front(1);
+  std::uint64_t cur_size = llvm::protobuf::loadVarInt(aBuffer);
+  if (cur_size > aBuffer.size())
+    return true;
+  llvm::StringRef contents = aBuffer.take_front(cur_size);
+  if (llvm::protobuf::loadVarInt(contents) !=
+      llvm::protobuf::getStringWire<1>::value)
+    return true;
+  return (llvm::protobuf::loadVarInt(contents) > contents.size());
+}
+
+void TemplightProtobufReader::skipSubtree() {
+  // Skip up to the end entry of the sub-tree, or up to the end of the buffer,
+  // such that it carries on in the next chunk or frame.
+  while (buffer.size() && (skipDepth > 0)) {
+    llvm::StringRef field_begin = buffer;
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(buffer);
+    if (cur_wire == llvm::protobuf::getStringWire<1>::value) {
+      // A new trace ends the sub-tree, which was cut short, but a
+      // continuation chunk only starts over the deltas.
+      if (getTraceChunk(cur_wire, field_begin) == 0) {
+        buffer = field_begin;
+        skipDepth = 0;
+        return;
+      }
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      loadHeader(buffer.slice(0, cur_size));
+      buffer = buffer.drop_front(cur_size);
+      continue;
+    }
+    if (cur_wire == llvm::protobuf::getStringWire<3>::value) {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      loadDictionaryEntry(buffer.slice(0, cur_size));
+      buffer = buffer.drop_front(cur_size);
+      continue;
+    }
+    if (cur_wire != llvm::protobuf::getStringWire<2>::value) {
+      llvm::protobuf::skipData(buffer, cur_wire);
+      continue;
+    }
     std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
     llvm::StringRef sub_buffer = buffer.slice(0, cur_size);
     buffer = buffer.drop_front(cur_size);
     cur_wire = llvm::protobuf::loadVarInt(sub_buffer);
     cur_size = llvm::protobuf::loadVarInt(sub_buffer);
+    if (cur_wire == llvm::protobuf::getStringWire<1>::value) {
+      ++skipDepth;
+      skipBeginEntry(sub_buffer);
+    } else if (cur_wire == llvm::protobuf::getStringWire<2>::value) {
+      --skipDepth;
+      skipEndEntry(sub_buffer);
+    }
+  }
+}
+
+void TemplightProtobufReader::loadSummaryEntry(llvm::StringRef aSubBuffer) {
+  // Set default values:
+  LastSummaryEntry.SynthesisKind = 0;
+  LastSummaryEntry.Line = 0;
+  LastSummaryEntry.Column = 0;
+  LastSummaryEntry.Count = 0;
+  LastSummaryEntry.InclusiveTime = 0.0;
+  LastSummaryEntry.ExclusiveTime = 0.0;
+  LastSummaryEntry.MaxDepth = 0;
+  llvm::StringRef Name;
+  std::size_t NameId = BeginEntryRef::NoId;
+  llvm::StringRef FileName;
+  std::size_t FileId = BeginEntryRef::NoId;
+
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
     switch (cur_wire) {
-    case llvm::protobuf::getStringWire<1>::value:
-      loadBeginEntry(sub_buffer);
+    case llvm::protobuf::getVarIntWire<1>::value:
+      LastSummaryEntry.SynthesisKind = llvm::protobuf::loadVarInt(aSubBuffer);
       break;
-    case llvm::protobuf::getStringWire<2>::value:
-      loadEndEntry(sub_buffer);
+    case llvm::protobuf::getStringWire<2>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
+      loadTemplateName(aSubBuffer.slice(0, cur_size), Name, NameId);
+      aSubBuffer = aSubBuffer.drop_front(cur_size);
+      break;
+    }
+    case llvm::protobuf::getStringWire<3>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
+      loadLocation(aSubBuffer.slice(0, cur_size), FileName, FileId,
+                   LastSummaryEntry.Line, LastSummaryEntry.Column);
+      aSubBuffer = aSubBuffer.drop_front(cur_size);
+      break;
+    }
+    case llvm::protobuf::getVarIntWire<4>::value:
+      LastSummaryEntry.Count = llvm::protobuf::loadVarInt(aSubBuffer);
       break;
-    default: // ignore for fwd-compat.
+    case llvm::protobuf::getDoubleWire<5>::value:
+      LastSummaryEntry.InclusiveTime = llvm::protobuf::loadDouble(aSubBuffer);
       break;
+    case llvm::protobuf::getDoubleWire<6>::value:
+      LastSummaryEntry.ExclusiveTime = llvm::protobuf::loadDouble(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<7>::value:
+      LastSummaryEntry.MaxDepth = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
+    }
+  }
+
+  if (NameId != BeginEntryRef::NoId)
+    Name = getName(NameId); // the summaries are few, and always named.
+  LastSummaryEntry.Name.assign(Name.data(), Name.size());
+  LastSummaryEntry.FileName.assign(FileName.data(), FileName.size());
+
+  LastChunk = TemplightProtobufReader::SummaryEntry;
+}
+
+bool TemplightProtobufReader::loadCompressedTrace(llvm::StringRef aSubBuffer) {
+  unsigned int Format = 0;
+  std::uint64_t Size = 0;
+  llvm::StringRef Data;
+
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getVarIntWire<1>::value:
+      Format = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<2>::value:
+      Size = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getStringWire<3>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(aSubBuffer);
+      Data = aSubBuffer.slice(0, cur_size);
+      aSubBuffer = aSubBuffer.drop_front(cur_size);
+      break;
+    }
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
+    }
+  }
+
+  if ((Format != 1) && (Format != 2))
+    return false;
+  llvm::compression::Format F =
+      (Format == 2 ? llvm::compression::Format::Zstd
+                   : llvm::compression::Format::Zlib);
+  if (const char *Reason = llvm::compression::getReasonIfUnsupported(F)) {
+    llvm::errs() << "Error: [Templight-Reader] Cannot decompress the trace: "
+                 << Reason << "\n";
+    return false;
+  }
+  decompressedTrace.clear();
+  if (llvm::Error Err = llvm::compression::decompress(
+          F, llvm::arrayRefFromStringRef(Data), decompressedTrace, Size)) {
+    llvm::errs() << "Error: [Templight-Reader] Cannot decompress the trace: "
+                 << llvm::toString(std::move(Err)) << "\n";
+    return false;
+  }
+  return true;
+}
+
+bool TemplightProtobufReader::loadTraceFrame() {
+  std::uint64_t Sync = llvm::protobuf::loadFixed64(buffer);
+  if (std::uint32_t(Sync) != TemplightProtobufWriter::FrameSyncMagic)
+    return false;
+  if (llvm::protobuf::loadVarInt(buffer) !=
+      llvm::protobuf::getStringWire<6>::value)
+    return false;
+  std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+  if (cur_size > buffer.size())
+    return false; // the frame was cut short.
+  remainder_buffer = buffer.drop_front(cur_size);
+  buffer = buffer.take_front(cur_size);
+  if (llvm::crc32(llvm::arrayRefFromStringRef(buffer)) != (Sync >> 32))
+    return false;
+  // The deltas start over in each frame.
+  lastTimeStamp = 0;
+  lastMemoryUsage = 0;
+  return true;
+}
+
+// Finds the next sync marker of a frame (its key and magic number), or
+// returns an empty buffer if there is none.
+static llvm::StringRef findFrameSyncMarker(llvm::StringRef aBuffer) {
+  char Marker[5];
+  Marker[0] = char(llvm::protobuf::getFixed64Wire<5>::value);
+  llvm::support::endian::write32le(Marker + 1,
+                                   TemplightProtobufWriter::FrameSyncMagic);
+  std::size_t Pos = aBuffer.find(llvm::StringRef(Marker, sizeof(Marker)));
+  if (Pos == llvm::StringRef::npos)
+    return llvm::StringRef();
+  return aBuffer.drop_front(Pos);
+}
+
+TemplightProtobufReader::LastChunkType
+TemplightProtobufReader::startOnBuffer(llvm::StringRef aBuffer) {
+  loadBuffer(aBuffer);
+  return next();
+}
+
+bool TemplightProtobufReader::loadBuffer(llvm::StringRef aBuffer) {
+  // NOTE: This loops over the corrupted parts of the input, in recovery mode.
+  while (!aBuffer.empty()) {
+    if (isTraceSeparator(aBuffer)) {
+      aBuffer = aBuffer.drop_front(1);
+      continue;
+    }
+    buffer = aBuffer;
+    readingCompressedTrace = false;
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(buffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getStringWire<1>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      remainder_buffer = buffer.slice(cur_size, buffer.size());
+      buffer = buffer.slice(0, cur_size);
+      return true;
+    }
+    case llvm::protobuf::getStringWire<2>::value: {
+      // A compressed trace, which holds the same contents as a plain one.
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      remainder_buffer = buffer.slice(cur_size, buffer.size());
+      if (!loadCompressedTrace(buffer.slice(0, cur_size)))
+        break;
+      decompressedChunk = ~0u;
+      readingCompressedTrace = true;
+      buffer = llvm::toStringRef(decompressedTrace);
+      return true;
+    }
+    case llvm::protobuf::getFixed64Wire<5>::value:
+      // A frame of a framed trace, which holds the next fields of the
+      // TemplightTrace.
+      if (loadTraceFrame())
+        return true;
+      break;
+    case llvm::protobuf::getStringWire<3>::value:
+    case llvm::protobuf::getFixed64Wire<4>::value:
+      // The index at the end of a trace, which other traces may follow.
+      llvm::protobuf::skipData(buffer, cur_wire);
+      aBuffer = buffer;
+      continue;
+    default: // not a trace.
+      break;
+    }
+    if (!recoveryMode)
+      break;
+    aBuffer = findFrameSyncMarker(aBuffer.drop_front(1));
+  }
+  buffer = llvm::StringRef();
+  remainder_buffer = llvm::StringRef();
+  return false;
+}
+
+bool TemplightProtobufReader::reportTruncation() {
+  // In recovery mode, a trace that ends while entries are still open was cut
+  // short, which is reported before moving on.
+  if (!recoveryMode || OpenEntries.empty() || truncationReported)
+    return false;
+  truncationReported = true;
+  LastChunk = TemplightProtobufReader::Truncated;
+  return true;
+}
+
+void TemplightProtobufReader::pushOpenEntry() {
+  OpenEntries.push_back(LastBeginEntry);
+  PrintableTemplightEntryBegin &Entry = OpenEntries.back();
+  Entry.Name.assign(LastBeginRef.Name.data(), LastBeginRef.Name.size());
+  Entry.FileName.assign(LastBeginRef.FileName.data(),
+                        LastBeginRef.FileName.size());
+  Entry.TempOri_FileName.assign(LastBeginRef.TempOri_FileName.data(),
+                                LastBeginRef.TempOri_FileName.size());
+  Entry.DictionaryId = LastBeginRef.NameId;
+}
+
+const char *TemplightProtobufReader::getInputPosition() const {
+  if (LastChunk == TemplightProtobufReader::EndOfFile)
+    return nullptr;
+  // A compressed trace was read entirely from the input, when decompressed.
+  return (readingCompressedTrace ? remainder_buffer.data() : buffer.data());
+}
+
+TemplightProtobufReader::LastChunkType TemplightProtobufReader::next() {
+  // NOTE: This loops over the sub-trees rejected by the entry filter.
+  while (true) {
+    if (buffer.empty()) {
+      if (remainder_buffer.empty()) {
+        if (!reportTruncation())
+          LastChunk = TemplightProtobufReader::EndOfFile;
+        return LastChunk;
+      }
+      loadBuffer(remainder_buffer);
+      continue;
+    }
+    if (skipDepth > 0) {
+      // A sub-tree rejected by the entry filter goes on in this buffer.
+      skipSubtree();
+      continue;
+    }
+    llvm::StringRef field_begin = buffer;
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(buffer);
+    if (recoveryMode && ((cur_wire & 0x7) == 2)) {
+      // The rest of the trace is dropped if the length of the field, or the
+      // field itself, was cut short.
+      llvm::StringRef field_contents = buffer;
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(field_contents);
+      if (buffer.empty() || (field_contents.data()[-1] & 0x80) ||
+          (cur_size > field_contents.size())) {
+        buffer = llvm::StringRef();
+        continue;
+      }
+    }
+    switch (cur_wire) {
+    case llvm::protobuf::getStringWire<1>::value: {
+      // Entries that are still open belong to a trace that was cut short.
+      if (reportTruncation()) {
+        buffer = field_begin;
+        return LastChunk;
+      }
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      loadHeader(buffer.slice(0, cur_size));
+      buffer = buffer.drop_front(cur_size);
+      if (Chunk != 0)
+        continue; // a continuation chunk is not a new trace.
+      return LastChunk;
     };
+    case llvm::protobuf::getStringWire<2>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      llvm::StringRef sub_buffer = buffer.slice(0, cur_size);
+      buffer = buffer.drop_front(cur_size);
+      cur_wire = llvm::protobuf::loadVarInt(sub_buffer);
+      cur_size = llvm::protobuf::loadVarInt(sub_buffer);
+      switch (cur_wire) {
+      case llvm::protobuf::getStringWire<1>::value:
+        if (!loadBeginEntry(sub_buffer)) {
+          skipDepth = 1;
+          continue;
+        }
+        if (recoveryMode)
+          pushOpenEntry();
+        break;
+      case llvm::protobuf::getStringWire<2>::value:
+        loadEndEntry(sub_buffer);
+        if (recoveryMode && !OpenEntries.empty())
+          OpenEntries.pop_back();
+        break;
+      default: // ignore for fwd-compat.
+        break;
+      };
+      return LastChunk;
+    };
+    case llvm::protobuf::getStringWire<3>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      loadDictionaryEntry(buffer.slice(0, cur_size));
+      buffer = buffer.drop_front(cur_size);
+      LastChunk = TemplightProtobufReader::Other;
+      return LastChunk;
+    };
+    case llvm::protobuf::getStringWire<4>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
+      loadSummaryEntry(buffer.slice(0, cur_size));
+      buffer = buffer.drop_front(cur_size);
+      return LastChunk;
+    };
+    default: { // ignore for fwd-compat.
+      llvm::protobuf::skipData(buffer, cur_wire);
+      continue;
+    };
+    }
+  }
+}
+
+void TemplightProtobufReader::loadIndexedChunk(llvm::StringRef aSubBuffer) {
+  IndexedChunk C = {0, 0, 0};
+
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getVarIntWire<1>::value:
+      C.Offset = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<2>::value:
+      C.NamesOffset = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<3>::value:
+      C.NamesSize = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
+    }
+  }
+
+  indexedChunks.push_back(C);
+}
+
+void TemplightProtobufReader::loadIndexedTree(llvm::StringRef aSubBuffer) {
+  IndexedTree T = {0, 0, 0, 0.0, 0.0, 0, 0};
+
+  while (aSubBuffer.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aSubBuffer);
+    switch (cur_wire) {
+    case llvm::protobuf::getVarIntWire<1>::value:
+      T.Chunk = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<2>::value:
+      T.Offset = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<3>::value:
+      T.Size = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getDoubleWire<4>::value:
+      T.TimeStamp = llvm::protobuf::loadDouble(aSubBuffer);
+      break;
+    case llvm::protobuf::getDoubleWire<5>::value:
+      T.Duration = llvm::protobuf::loadDouble(aSubBuffer);
+      break;
+    case llvm::protobuf::getSIntWire<6>::value:
+      T.BaseTime = llvm::protobuf::loadSInt(aSubBuffer);
+      break;
+    case llvm::protobuf::getVarIntWire<7>::value:
+      T.BaseMemory = llvm::protobuf::loadVarInt(aSubBuffer);
+      break;
+    default:
+      llvm::protobuf::skipData(aSubBuffer, cur_wire);
+      break;
+    }
+  }
+
+  IndexedTrees.push_back(T);
+}
+
+bool TemplightProtobufReader::loadIndex(llvm::StringRef aBuffer) {
+  file_buffer = aBuffer;
+  indexedChunks.clear();
+  indexedFileNames.clear();
+  IndexedTrees.clear();
+  fileNameMap.clear();
+  dictionaryEntries.clear();
+  dictionaryMarkers.clear();
+  expandedNames.clear();
+  loadedChunks = 0;
+  decompressedChunk = ~0u;
+
+  // The file ends with the offset of the index, as a fixed64 field.
+  const std::size_t tail_size = 1 + sizeof(std::uint64_t);
+  if (aBuffer.size() < tail_size)
+    return false;
+  llvm::StringRef tail = aBuffer.take_back(tail_size);
+  if (llvm::protobuf::loadVarInt(tail) !=
+      llvm::protobuf::getFixed64Wire<4>::value)
+    return false;
+  // NOTE: The offsets go backwards from the index, which is right before
+  // its offset.
+  std::uint64_t index_offset = llvm::protobuf::loadFixed64(tail);
+  if ((index_offset == 0) || (index_offset > aBuffer.size() - tail_size))
+    return false;
+  std::uint64_t index_position = aBuffer.size() - tail_size - index_offset;
+
+  llvm::StringRef index =
+      aBuffer.slice(index_position, aBuffer.size() - tail_size);
+  if (llvm::protobuf::loadVarInt(index) !=
+      llvm::protobuf::getStringWire<3>::value)
+    return false;
+  if (llvm::protobuf::loadVarInt(index) != index.size())
+    return false;
+
+  while (index.size()) {
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(index);
+    switch (cur_wire) {
+    case llvm::protobuf::getStringWire<1>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(index);
+      loadIndexedChunk(index.slice(0, cur_size));
+      index = index.drop_front(cur_size);
+      break;
+    }
+    case llvm::protobuf::getStringWire<2>::value: {
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(index);
+      loadIndexedTree(index.slice(0, cur_size));
+      index = index.drop_front(cur_size);
+      break;
+    }
+    case llvm::protobuf::getStringWire<3>::value:
+      indexedFileNames.push_back(llvm::protobuf::loadStringRef(index));
+      break;
+    default:
+      llvm::protobuf::skipData(index, cur_wire);
+      break;
+    }
+  }
+
+  // Each chunk must be a (compressed) trace, in front of the index.
+  for (IndexedChunk &C : indexedChunks) {
+    if ((C.Offset == 0) || (C.Offset > index_position))
+      return false;
+    C.Offset = index_position - C.Offset;
+    llvm::StringRef chunk = aBuffer.drop_front(C.Offset);
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(chunk);
+    if ((cur_wire != llvm::protobuf::getStringWire<1>::value) &&
+        (cur_wire != llvm::protobuf::getStringWire<2>::value))
+      return false;
+  }
+  return true;
+}
+
+void TemplightProtobufReader::getSlowestTrees(
+    std::size_t N, std::vector<std::size_t> &Trees) const {
+  Trees.resize(IndexedTrees.size());
+  std::iota(Trees.begin(), Trees.end(), std::size_t(0));
+  N = std::min(N, Trees.size());
+  std::partial_sort(Trees.begin(), Trees.begin() + N, Trees.end(),
+                    [this](std::size_t A, std::size_t B) {
+                      return IndexedTrees[A].Duration >
+                             IndexedTrees[B].Duration;
+                    });
+  Trees.resize(N);
+}
+
+bool TemplightProtobufReader::getChunkContents(unsigned aChunk,
+                                               llvm::StringRef &Contents) {
+  if ((aChunk >= indexedChunks.size()) ||
+      (indexedChunks[aChunk].Offset >= file_buffer.size()))
+    return false;
+  llvm::StringRef chunk_buffer =
+      file_buffer.drop_front(indexedChunks[aChunk].Offset);
+  unsigned int cur_wire = llvm::protobuf::loadVarInt(chunk_buffer);
+  std::uint64_t cur_size = llvm::protobuf::loadVarInt(chunk_buffer);
+  chunk_buffer = chunk_buffer.slice(0, cur_size);
+  if (cur_wire == llvm::protobuf::getStringWire<1>::value) {
+    Contents = chunk_buffer;
+    return true;
+  }
+  if (cur_wire != llvm::protobuf::getStringWire<2>::value)
+    return false;
+  if (decompressedChunk != aChunk) {
+    decompressedChunk = ~0u;
+    if (!loadCompressedTrace(chunk_buffer))
+      return false;
+    decompressedChunk = aChunk;
+  }
+  Contents = llvm::toStringRef(decompressedTrace);
+  return true;
+}
+
+TemplightProtobufReader::LastChunkType
+TemplightProtobufReader::seekToTree(std::size_t aTree) {
+  buffer = llvm::StringRef();
+  remainder_buffer = llvm::StringRef();
+  LastChunk = TemplightProtobufReader::EndOfFile;
+  if (aTree >= IndexedTrees.size())
     return LastChunk;
-  };
-  case llvm::protobuf::getStringWire<3>::value: {
-    std::uint64_t cur_size = llvm::protobuf::loadVarInt(buffer);
-    loadDictionaryEntry(buffer.slice(0, cur_size));
-    buffer = buffer.drop_front(cur_size);
-    LastChunk = TemplightProtobufReader::Other;
+  const IndexedTree &T = IndexedTrees[aTree];
+
+  // The names of each chunk are together, right after its header, so only
+  // those need to be read from the chunks before the tree.
+  llvm::StringRef contents;
+  for (; loadedChunks <= T.Chunk; ++loadedChunks) {
+    if (!getChunkContents(loadedChunks, contents))
+      return LastChunk;
+    llvm::StringRef header = contents;
+    if (llvm::protobuf::loadVarInt(header) ==
+        llvm::protobuf::getStringWire<1>::value)
+      loadHeader(header.slice(0, llvm::protobuf::loadVarInt(header)));
+    const IndexedChunk &C = indexedChunks[loadedChunks];
+    llvm::StringRef names = contents.substr(C.NamesOffset, C.NamesSize);
+    while (names.size()) {
+      unsigned int cur_wire = llvm::protobuf::loadVarInt(names);
+      if (cur_wire != llvm::protobuf::getStringWire<3>::value) {
+        llvm::protobuf::skipData(names, cur_wire);
+        continue;
+      }
+      std::uint64_t cur_size = llvm::protobuf::loadVarInt(names);
+      loadDictionaryEntry(names.slice(0, cur_size));
+      names = names.drop_front(cur_size);
+    }
+  }
+  if (!getChunkContents(T.Chunk, contents))
     return LastChunk;
-  };
-  default: { // ignore for fwd-compat.
-    llvm::protobuf::skipData(buffer, cur_wire);
-    return next(); // tail-call
-  };
+
+  fileNameMap = indexedFileNames;
+  lastTimeStamp = T.BaseTime;
+  lastMemoryUsage = T.BaseMemory;
+  entryDepth = 0;
+  skipDepth = 0;
+  OpenEntries.clear();
+  truncationReported = false;
+  buffer = contents.substr(T.Offset, T.Size);
+  return next();
+}
+
+void TemplightProtobufReader::splitTraces(
+    llvm::StringRef aBuffer, std::vector<llvm::StringRef> &Traces) {
+  Traces.clear();
+  while (aBuffer.size()) {
+    if (isTraceSeparator(aBuffer)) {
+      aBuffer = aBuffer.drop_front(1);
+      continue;
+    }
+    const char *field_begin = aBuffer.data();
+    unsigned int cur_wire = llvm::protobuf::loadVarInt(aBuffer);
+    if (cur_wire == llvm::protobuf::getFixed64Wire<5>::value) {
+      // The sync marker of a frame, which goes along with the frame.
+      llvm::protobuf::skipData(aBuffer, cur_wire);
+      cur_wire = llvm::protobuf::loadVarInt(aBuffer);
+    }
+    if ((cur_wire != llvm::protobuf::getStringWire<1>::value) &&
+        (cur_wire != llvm::protobuf::getStringWire<2>::value) &&
+        (cur_wire != llvm::protobuf::getStringWire<6>::value)) {
+      // Not a trace (e.g., the index at the end of each merged file).
+      llvm::protobuf::skipData(aBuffer, cur_wire);
+      continue;
+    }
+    std::uint64_t cur_size = llvm::protobuf::loadVarInt(aBuffer);
+    llvm::StringRef contents = aBuffer.slice(0, cur_size);
+    aBuffer = aBuffer.slice(cur_size, aBuffer.size()); // if cut short.
+    // Only the first frame of a framed trace has a header.
+    bool has_header = true;
+    if (cur_wire == llvm::protobuf::getStringWire<6>::value) {
+      llvm::StringRef first_field = contents;
+      has_header = (llvm::protobuf::loadVarInt(first_field) ==
+                    llvm::protobuf::getStringWire<1>::value);
+    }
+    unsigned int chunk = getTraceChunk(cur_wire, contents);
+    if ((has_header && (chunk == 0)) || Traces.empty())
+      Traces.push_back(llvm::StringRef(field_begin, 0));
+    // Extend the current trace up to the end of this chunk.
+    Traces.back() = llvm::StringRef(Traces.back().data(),
+                                    aBuffer.data() - Traces.back().data());
+  }
+}
+
+void TemplightProtobufReader::readTracesInParallel(
+    llvm::StringRef aBuffer,
+    llvm::function_ref<void(std::size_t, TemplightProtobufReader &)>
+        aReadTrace,
+    unsigned aThreads) {
+  std::vector<llvm::StringRef> traces;
+  splitTraces(aBuffer, traces);
+
+  llvm::DefaultThreadPool Pool(llvm::hardware_concurrency(aThreads));
+  for (std::size_t i = 0; i < traces.size(); ++i) {
+    Pool.async([&aReadTrace, &traces, i]() {
+      TemplightProtobufReader Reader;
+      Reader.startOnBuffer(traces[i]);
+      aReadTrace(i, Reader);
+    });
   }
+  Pool.wait();
 }
 
 } // namespace clang
@@ -12,8 +12,15 @@
 
 #include "PrintableTemplightEntries.h"
 
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/STLFunctionalExtras.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Allocator.h>
+#include <llvm/Support/StringSaver.h>
 
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -24,14 +31,70 @@ private:
   llvm::StringRef buffer;
   llvm::StringRef remainder_buffer;
 
-  std::vector<std::string> fileNameMap;
-  std::vector<std::string> templateNameMap;
+  // The file names and the dictionary entries (in their marked form) are
+  // saved once in the arena. The names are only expanded when they are used,
+  // and the expanded names are saved there as well, if memoized.
+  struct DictionaryEntry {
+    llvm::StringRef MarkedName;
+    std::size_t FirstMarker; // in dictionaryMarkers.
+    std::size_t NumMarkers;
+  };
+  llvm::BumpPtrAllocator nameArena;
+  llvm::StringSaver nameSaver;
+  std::vector<llvm::StringRef> fileNameMap;
+  std::vector<DictionaryEntry> dictionaryEntries;
+  std::vector<std::size_t> dictionaryMarkers;
+  std::vector<llvm::StringRef> expandedNames; // memoized, if non-null.
+  llvm::SmallString<256> nameScratch;
+  llvm::SmallVector<std::uint8_t, 0> decompressedName;
+  bool copyNames;
+  bool lazyNames;
+  bool memoizeNames;
 
+  // The contents of the current trace, if it was compressed.
+  llvm::SmallVector<std::uint8_t, 0> decompressedTrace;
+  bool readingCompressedTrace;
+
+  // The last time-stamp (in nanoseconds) and memory usage, for version 2.
+  std::int64_t lastTimeStamp;
+  std::uint64_t lastMemoryUsage;
+
+  // The index of the trace file, if it has one.
+  struct IndexedChunk {
+    std::uint64_t Offset;
+    std::uint64_t NamesOffset;
+    std::uint64_t NamesSize;
+  };
+  llvm::StringRef file_buffer;
+  std::vector<IndexedChunk> indexedChunks;
+  std::vector<llvm::StringRef> indexedFileNames;
+  unsigned loadedChunks;      // the chunks whose names are loaded.
+  unsigned decompressedChunk; // the chunk in decompressedTrace, if any.
+
+  void applyEntryDeltas(std::int64_t TimeDelta, std::int64_t MemoryDelta,
+                        double &TimeStamp, std::uint64_t &MemoryUsage);
+
+  bool loadCompressedTrace(llvm::StringRef aSubBuffer);
+  bool loadTraceFrame();
+  bool reportTruncation();
+  void pushOpenEntry();
   void loadHeader(llvm::StringRef aSubBuffer);
   void loadDictionaryEntry(llvm::StringRef aSubBuffer);
-  void loadTemplateName(llvm::StringRef aSubBuffer);
-  void loadBeginEntry(llvm::StringRef aSubBuffer);
+  void expandName(std::size_t NameId, llvm::SmallVectorImpl<char> &Name);
+  void loadLocation(llvm::StringRef aSubBuffer, llvm::StringRef &FileName,
+                    std::size_t &FileId, int &Line, int &Column);
+  void loadTemplateName(llvm::StringRef aSubBuffer, llvm::StringRef &Name,
+                        std::size_t &NameId);
+  bool loadBeginEntry(llvm::StringRef aSubBuffer);
   void loadEndEntry(llvm::StringRef aSubBuffer);
+  void skipBeginEntry(llvm::StringRef aSubBuffer);
+  void skipEndEntry(llvm::StringRef aSubBuffer);
+  void skipSubtree();
+  bool loadBuffer(llvm::StringRef aBuffer);
+  void loadSummaryEntry(llvm::StringRef aSubBuffer);
+  void loadIndexedChunk(llvm::StringRef aSubBuffer);
+  void loadIndexedTree(llvm::StringRef aSubBuffer);
+  bool getChunkContents(unsigned aChunk, llvm::StringRef &Contents);
 
 public:
   enum LastChunkType {
@@ -39,19 +102,150 @@ public:
     Header,
     BeginEntry,
     EndEntry,
-    Other
+    SummaryEntry,
+    Other,
+    Truncated
   } LastChunk;
 
   unsigned int Version;
   std::string SourceName;
+  unsigned int Chunk;
 
   PrintableTemplightEntryBegin LastBeginEntry;
+
+  /// \brief The names of the last begin entry (the rest is in
+  /// LastBeginEntry), without copies, along with the ids of the name and
+  /// files (or NoId). The file names and the memoized names remain valid as
+  /// long as the reader, the others until the next entry.
+  struct BeginEntryRef {
+    static constexpr std::size_t NoId = ~std::size_t(0);
+    llvm::StringRef Name;
+    std::size_t NameId;
+    llvm::StringRef FileName;
+    std::size_t FileId;
+    llvm::StringRef TempOri_FileName;
+    std::size_t TempOri_FileId;
+  } LastBeginRef;
   PrintableTemplightEntryEnd LastEndEntry;
+  PrintableTemplightSummaryEntry LastSummaryEntry;
+
+  /// \brief The start time, duration and place in the trace of a top-level
+  /// instantiation tree, as recorded in the index of the trace file.
+  struct IndexedTree {
+    unsigned Chunk;
+    std::uint64_t Offset;
+    std::uint64_t Size;
+    double TimeStamp;
+    double Duration;
+    std::int64_t BaseTime;
+    std::uint64_t BaseMemory;
+  };
+  std::vector<IndexedTree> IndexedTrees;
+
+  /// \brief In recovery mode, the begin entries whose end has not been read
+  /// yet, the outermost first (with the DictionaryId of their name, which is
+  /// left empty if the names are lazy). When next() returns Truncated, this
+  /// is the instantiation stack at the point where the trace was cut short.
+  std::vector<PrintableTemplightEntryBegin> OpenEntries;
 
   TemplightProtobufReader();
 
   LastChunkType startOnBuffer(llvm::StringRef aBuffer);
   LastChunkType next();
+
+  /// \brief Gets the position in the buffer given to startOnBuffer up to
+  /// which it has been read (or null at the end), such that the memory of
+  /// what comes before can be released.
+  const char *getInputPosition() const;
+
+  /// \brief Sets whether the names of the begin entries are copied into
+  /// LastBeginEntry (the default), or only given by LastBeginRef.
+  void setCopyNames(bool aCopyNames) { copyNames = aCopyNames; }
+
+  /// \brief Sets whether the names from the dictionary are left unexpanded
+  /// when the entries are read (i.e., only their NameId is given), for the
+  /// consumers that only need them for some of the entries, or not at all.
+  void setLazyNames(bool aLazyNames) { lazyNames = aLazyNames; }
+
+  /// \brief Sets whether the names from the dictionary are kept once they
+  /// have been expanded (the default), or expanded again every time.
+  void setMemoizeNames(bool aMemoizeNames) { memoizeNames = aMemoizeNames; }
+
+  /// \brief Sets whether the reader recovers from corrupted or truncated
+  /// traces (e.g., of a crashed compilation), instead of stopping at the
+  /// first malformed field. It then skips to the next intact frame of a
+  /// framed trace (see TemplightProtobufWriter::setTraceFrames), drops the
+  /// fields that are cut short, and keeps track of the OpenEntries, such
+  /// that a trace that ends with open entries is reported as Truncated
+  /// (once, before the next trace or the EndOfFile). A frame lost in the
+  /// middle of a trace can take dictionary entries with it, which makes the
+  /// names of the later entries unreliable.
+  void setRecoveryMode(bool aRecoveryMode) { recoveryMode = aRecoveryMode; }
+
+  /// \brief Gets the full name of a dictionary entry. If the names are not
+  /// memoized, it is only valid until the next call.
+  llvm::StringRef getName(std::size_t NameId);
+
+  /// \brief What an entry filter is given of a begin entry, before its names
+  /// are expanded or copied.
+  struct EntryFilterInfo {
+    int SynthesisKind;
+    std::size_t NameId; // or NoId, if the name is not from the dictionary.
+    std::size_t FileId;
+    unsigned Depth; // from zero, for the top-level instantiations.
+  };
+
+  /// \brief Sets a filter on the begin entries. A rejected entry is skipped
+  /// along with all the entries under it, by only going through their
+  /// lengths (and through what the next entries depend on: the new file
+  /// names, the dictionary entries and the deltas of version 2). Filters on
+  /// names can call getName, and keep their decisions by NameId.
+  void setEntryFilter(std::function<bool(const EntryFilterInfo &)> aFilter) {
+    entryFilter = std::move(aFilter);
+  }
+
+  /// \brief Loads the index at the end of a trace file (see the -trace-index
+  /// option), returns false if the file has none. The buffer must hold the
+  /// whole file and outlive the reader. Only the index of the last trace of
+  /// concatenated files can be found, which covers that trace only.
+  bool loadIndex(llvm::StringRef aBuffer);
+
+  /// \brief Gets the indices (into IndexedTrees) of the \p N slowest trees,
+  /// the slowest first.
+  void getSlowestTrees(std::size_t N, std::vector<std::size_t> &Trees) const;
+
+  /// \brief Moves to the given tree of the index, such that it can be read
+  /// with next() until EndOfFile, after loading the names it needs (but not
+  /// the entries that come before it). This cannot be mixed with reading the
+  /// file from startOnBuffer.
+  LastChunkType seekToTree(std::size_t aTree);
+
+  /// \brief Splits a collection of traces (e.g., of a whole build) into its
+  /// traces, each one along with its continuation chunks, such that each one
+  /// can be read by its own reader. This only goes through the length of each
+  /// trace and its chunk number, without decoding or decompressing it. The
+  /// newline that the driver appends to each file it merges is skipped.
+  static void splitTraces(llvm::StringRef aBuffer,
+                          std::vector<llvm::StringRef> &Traces);
+
+  /// \brief Reads the traces of a collection in parallel, on a pool of \p
+  /// aThreads threads (or one per core, if zero). \p aReadTrace is called on
+  /// the pool with the index of each trace and a reader that was started on
+  /// it (see LastChunk), which it reads to the end, and which is destroyed
+  /// after that (so the results are put aside by index, and aggregated once
+  /// this returns).
+  static void readTracesInParallel(
+      llvm::StringRef aBuffer,
+      llvm::function_ref<void(std::size_t, TemplightProtobufReader &)>
+          aReadTrace,
+      unsigned aThreads = 0);
+
+private:
+  std::function<bool(const EntryFilterInfo &)> entryFilter;
+  unsigned entryDepth; // of the entries read, without the skipped ones.
+  unsigned skipDepth;  // of the rejected sub-tree, across chunks and frames.
+  bool recoveryMode;
+  bool truncationReported; // for the current OpenEntries.
 };
 
 } // namespace clang